@@ -1,4 +1,6 @@
 // This program simulates hotel booking system
+// Build: g++ -std=c++17 -O2 -pthread hotel.cpp -o hotel
+// Test:  tests/regression.sh (batch-mode regression; run after every build)
 #include <iostream>
 #include <vector>
 #include <string>
@@ -7,60 +9,1011 @@
 #include <limits>
 #include <algorithm>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <random>
+#include <functional>
+#include <future>
+#include <memory>
+#include <condition_variable>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
 
 using namespace std;
 
 //  1. Constants and global variables 
 const int MAX_ROOMS = 300;
-const int MAX_SINGLE_ROOMS = 150;
-const int MAX_DOUBLE_ROOMS = 150;
 
-// Structure to represent a hotel room
-struct Room 
+// Booking horizon: day 0 is tonight, the last bookable night is day 364
+const int CALENDAR_DAYS = 365;
+const int MAX_NIGHTS = 30;
+
+// How stays of a room type are priced (see priceStay)
+struct PricingPolicy
+{
+    int peakSurchargePercent;     // Added to the nightly rate on peak nights
+    int longStayNights;           // Stays of at least this many nights...
+    int longStayDiscountPercent;  // ...get this much off the discounted total
+    int breakfastDiscountPercent; // Taken off the total when breakfast is added
+    int maxDemandDiscountPercent; // Discount on nights with no demand (see RateTable)
+};
+
+// One room type. Rooms of a type are numbered consecutively, in table
+// order, and a new hotel gets each type's share of its rooms.
+struct RoomTypeInfo
+{
+    const char* name;       // Name in commands and exports ("single")
+    const char* label;      // Name in listings ("Single")
+    int guests;             // Persons the room sleeps
+    int sharePercent;       // Share of the rooms of a new hotel
+    int minPriceEur;        // Price range per night of a new hotel
+    int maxPriceEur;
+    PricingPolicy pricing;  // How its stays are priced
+};
+
+// Every room type. Adding a type is adding a row; the index of a row is
+// the type's index in per-type tables (SINGLE_ROOM, DOUBLE_ROOM, ...).
+constexpr RoomTypeInfo ROOM_TYPES[] = {
+    // name         label         guests share  EUR/night    peak  long stay  breakfast  demand
+    {"single",     "Single",      1,     40,    80, 100,    {15,    7,  5,     5,        30}},
+    {"double",     "Double",      2,     30,   120, 150,    {15,    7,  5,     5,        30}},
+    {"twin",       "Twin",        2,     15,   110, 140,    {15,    7,  5,     5,        30}},
+    {"suite",      "Suite",       4,     10,   250, 400,    {25,   14, 10,    10,        20}},
+    {"accessible", "Accessible",  2,      5,   100, 130,    { 0,    7,  5,     5,        15}},
+};
+constexpr int ROOM_TYPE_COUNT = sizeof(ROOM_TYPES) / sizeof(ROOM_TYPES[0]);
+constexpr int SINGLE_ROOM = 0;
+constexpr int DOUBLE_ROOM = 1;
+
+// Peak periods of the booking horizon, in days from tonight (inclusive)
+struct PeakSeason
+{
+    int firstDay;
+    int lastDay;
+};
+
+constexpr PeakSeason PEAK_SEASONS[] = {{60, 120}, {240, 270}};
+
+// Demand pricing. A night's demand is its occupancy, moved up or down
+// by half the gap between that occupancy and the pace curve: the
+// occupancy a night is expected to have reached at its lead time (85%
+// on the night itself, falling to 0% for nights 120 or more days out).
+// New bookings get the room type's maxDemandDiscountPercent scaled by
+// the share of demand that is missing, so the base price is only charged
+// for nights that are full or filling ahead of pace.
+constexpr int PACE_TARGET_PERCENT = 85;  // Expected occupancy on the night itself
+constexpr int PACE_HORIZON_DAYS = 120;   // Lead time from which nothing is expected yet
+constexpr int PACE_WEIGHT_PERCENT = 50;  // Share of the gap to the pace curve added to demand
+
+// Per-type columns hold at least one AVX2 register of entries, so the
+// pricing kernel can look them up with a register permute
+constexpr int POLICY_COLUMN = ROOM_TYPE_COUNT < 8 ? 8 : ROOM_TYPE_COUNT;
+
+// Rows of the per-type tables are padded to powers of two, so priceStay
+// finds a type's row with a shift rather than a multiply
+constexpr int NIGHT_ROW = 512; // Entries per nightPercentBefore row (> CALENDAR_DAYS)
+constexpr int STAY_ROW = 32;   // Entries per stayFactor row (> MAX_NIGHTS)
+static_assert(NIGHT_ROW > CALENDAR_DAYS && STAY_ROW > MAX_NIGHTS, "Table rows must cover the calendar");
+
+// Lookup tables derived from the tables above at compile time, so that
+// pricing a stay is a handful of loads and multiplies
+struct PricingTables
+{
+    int32_t nightPercentBefore[ROOM_TYPE_COUNT][NIGHT_ROW]; // Sum of nightly rates (% of
+                                                            // base) over days [0, d)
+    int32_t stayFactor[ROOM_TYPE_COUNT][STAY_ROW][2];       // (100 - long stay %) x
+                                                            // (100 - breakfast %), by
+                                                            // nights and breakfast
+    int32_t nightWeights[POLICY_COLUMN];         // Policy columns, per room type. Two 16-bit
+                                                 // weights: 100 per night, the peak surcharge
+                                                 // per peak night (for _mm256_madd_epi16)
+    int32_t shortStayNights[POLICY_COLUMN];      // Most nights without the long-stay discount
+    int32_t longStayDiscount[POLICY_COLUMN];
+    int32_t breakfastDiscount[POLICY_COLUMN];
+    int maxPeakSurcharge;                        // Largest peak surcharge of any type
+    int totalShare;                              // Sum of the room shares
+};
+
+constexpr PricingTables buildPricingTables()
+{
+    PricingTables tables{};
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        const PricingPolicy& policy = ROOM_TYPES[t].pricing;
+        for (int d = 0; d < CALENDAR_DAYS; d++) {
+            bool peak = false;
+            for (const PeakSeason& season : PEAK_SEASONS) {
+                peak = peak || (d >= season.firstDay && d <= season.lastDay);
+            }
+            tables.nightPercentBefore[t][d + 1] = tables.nightPercentBefore[t][d] + 100 +
+                                                  (peak ? policy.peakSurchargePercent : 0);
+        }
+        for (int n = 0; n <= MAX_NIGHTS; n++) {
+            int longStayFactor = 100 - (n >= policy.longStayNights ? policy.longStayDiscountPercent : 0);
+            tables.stayFactor[t][n][0] = longStayFactor * 100;
+            tables.stayFactor[t][n][1] = longStayFactor * (100 - policy.breakfastDiscountPercent);
+        }
+        tables.nightWeights[t] = 100 | policy.peakSurchargePercent << 16;
+        tables.shortStayNights[t] = policy.longStayNights - 1;
+        tables.longStayDiscount[t] = policy.longStayDiscountPercent;
+        tables.breakfastDiscount[t] = policy.breakfastDiscountPercent;
+        tables.maxPeakSurcharge = max(tables.maxPeakSurcharge, policy.peakSurchargePercent);
+        tables.totalShare += ROOM_TYPES[t].sharePercent;
+    }
+    return tables;
+}
+
+constexpr PricingTables PRICING = buildPricingTables();
+
+// Largest base price accepted. Every stay product then stays below 2^53,
+// where the AVX2 kernel computes and divides it exactly in doubles
+// (priceReservationsAvx2).
+constexpr int32_t MAX_BASE_PRICE_CENTS = 1000000; // 10,000 EUR per night
+
+static_assert(PRICING.totalShare == 100, "Room type shares must add up to 100%");
+static_assert(PRICING.maxPeakSurcharge < 32768, "Peak surcharges must fit the kernel's 16-bit weights");
+static_assert(double(MAX_BASE_PRICE_CENTS) * MAX_NIGHTS * (100 + PRICING.maxPeakSurcharge) * 1000000 <
+              9007199254740992.0, "Stay products must stay exact in doubles");
+
+/**
+ * Prices one stay; the single definition of what a reservation costs
+ * Each night costs the base price, plus the type's surcharge on peak
+ * nights. The booking, long-stay and breakfast discounts each come
+ * off what is left, and the total is rounded half up once.
+ * @param roomType Index into ROOM_TYPES
+ * @param baseCents Price per night, in cents
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param discountPercent Discount given at booking (0-100 %)
+ * @param hasBreakfast True to take the breakfast discount off the total
+ * @return Total in cents
+ */
+constexpr int64_t priceStay(int roomType, int32_t baseCents, int arrivalDay, int nights,
+                            int discountPercent, bool hasBreakfast)
+{
+    const int32_t* nightPercentBefore = PRICING.nightPercentBefore[roomType];
+    uint32_t nightPercent = nightPercentBefore[arrivalDay + nights] - nightPercentBefore[arrivalDay];
+    uint64_t scaled = uint64_t(baseCents) * nightPercent *
+                      uint32_t((100 - discountPercent) * PRICING.stayFactor[roomType][nights][hasBreakfast]);
+    return static_cast<int64_t>((scaled + 50000000) / 100000000);
+}
+
+// Worked examples, checked by the compiler
+static_assert(priceStay(SINGLE_ROOM, 9000, 0, 3, 10, true) == 23085, "3 nights, 10% off, breakfast");
+static_assert(priceStay(SINGLE_ROOM, 9000, 59, 2, 0, false) == 19350, "1 of 2 nights in peak season");
+static_assert(priceStay(DOUBLE_ROOM, 12000, 0, 7, 20, false) == 63840, "5% long stay after a 20% discount");
+
+// Columnar store of all hotel rooms: one array per attribute, so a scan
+// only pulls the column it reads through the cache.
+// Room numbers are not stored: room index i is room number i + 1.
+struct RoomStore
+{
+    vector<uint8_t> type;       // Room type (index into ROOM_TYPES)
+    vector<int32_t> basePriceCents; // Price per night, in cents
+    vector<uint32_t> claim;     // Nonzero while a thread is taking the room's nights (not saved)
+};
+
+// Reservation status flags, packed into one byte per slot
+const uint8_t RES_ACTIVE = 1;    // Slot holds a live reservation
+const uint8_t RES_BREAKFAST = 2; // Breakfast included
+
+// Interned guest names. Every distinct name is stored once in an arena
+// of fixed-size blocks, followed by its case-folded key for the name
+// index, and referenced by a stable 32-bit handle, so repeat guests and
+// group bookings share one copy and booking a known guest allocates
+// nothing. Arena bytes never move between compactions, so the lookup
+// table can key on views into them. Handles are reference-counted and
+// recycled once no reservation uses them.
+const size_t GUEST_ARENA_BLOCK = 1 << 16; // Bytes per arena block
+
+struct GuestNamePool
+{
+    vector<unique_ptr<char[]>> blocks;  // Arena blocks, oldest first
+    size_t blockSize = 0;               // Size of the last block
+    size_t blockUsed = 0;               // Bytes used in the last block
+    size_t arenaBytes = 0;              // Bytes written to the arena
+    size_t liveBytes = 0;               // Arena bytes of names still referenced
+    vector<const char*> text;           // Per handle: the name, then its folded key
+    vector<uint32_t> length;            // Per handle: length of the name
+    vector<uint32_t> references;        // Per handle: reservations using it (0 = free)
+    vector<uint32_t> freeHandles;       // Handles waiting for reuse
+    unordered_map<string_view, uint32_t> handles; // Name -> handle (views into the arena)
+};
+
+// Columnar store of reservations, one slot per booking of a room for a
+// range of nights. The hot columns (status, room, dates) are packed and
+// kept apart from the guest names, which only listings read.
+struct ReservationStore
+{
+    vector<uint8_t> status;         // RES_* flags
+    vector<int32_t> roomIndex;      // Index of the booked room
+    vector<int16_t> arrivalDay;     // First night, in days from today (0 = tonight)
+    vector<uint8_t> nights;         // Number of nights stayed
+    vector<int32_t> reservationId;  // Unique reservation ID
+    vector<uint8_t> discountPercent; // Applied discount (0-100 %)
+    vector<uint32_t> guestHandle;   // Guest name (handle into guestNames)
+    GuestNamePool guestNames;       // Interned guest names
+    vector<int> freeSlots;          // Slots of cancelled reservations
+};
+
+// Hands out reservation IDs that are unique among live bookings.
+// Fresh IDs are drawn at random from the current range without repeats
+// (a lazily stored Fisher-Yates shuffle). Once the range is used up,
+// cancelled IDs are reused, and only then is the next, one digit wider,
+// range opened (10000-99999, then 100000-999999, ...).
+// Offsets into the range are shuffled; positions below 'drawn' are taken.
+struct IdAllocator
+{
+    int rangeLow = 10000;               // Smallest ID of the current range
+    int rangeHigh = 99999;              // Largest ID of the current range
+    int drawn = 0;                      // IDs already drawn from the range
+    unordered_map<int, int> valueAt;    // Shuffle position -> offset (if not identity)
+    unordered_map<int, int> positionOf; // Offset -> shuffle position (if not identity)
+    vector<int> freedIds;               // Cancelled IDs waiting for reuse
+};
+
+// Case-folded guest names with a trigram index for substring search.
+// Every 3-character window of a folded name has a postings list of the
+// reservations whose name contains it, so a query only has to check the
+// reservations listed under its rarest trigram.
+struct NameIndex
+{
+    unordered_map<uint32_t, vector<int>> postings;  // Trigram -> reservation slots
+    vector<vector<pair<uint32_t, int>>> slotTrigrams; // Per slot: (trigram, position in postings)
+    bool built = true;                              // False until first use after a snapshot load
+};
+
+// Room x day occupancy bitmap. Each day has one row with a bit per room
+// (set = free that night); a range query ANDs the rows of its nights
+// with the mask of the wanted room type, a word (64 rooms) at a time.
+struct Calendar
+{
+    int wordsPerDay = 0;                    // 64-bit words per day row
+    vector<uint64_t> freeBits;              // CALENDAR_DAYS rows, day-major
+    vector<uint64_t> typeMask[ROOM_TYPE_COUNT]; // Rooms of each type
+};
+
+const int ASSIGN_ROOM_PROBES = 8; // Random rooms tried before building a free-room mask
+
+// Running totals over active reservations, updated on every booking and
+// cancellation so that summary queries never scan the reservations
+struct HotelTotals
+{
+    int reservations[ROOM_TYPE_COUNT] = {0};   // Active reservations per room type
+    int64_t roomNights[ROOM_TYPE_COUNT] = {0}; // Nights booked per room type
+    vector<int> bookedPerDay[ROOM_TYPE_COUNT]; // Rooms of each type booked per day
+    int64_t revenueCents = 0;                  // Sum of reservation totals
+    int64_t discountBasisPoints = 0;           // Sum of discounts (1% = 100)
+    int breakfasts = 0;                        // Reservations with breakfast
+};
+
+// Demand discount of every room type on every night, kept current as
+// bookings land: a booking or cancellation recomputes only the nights
+// it covers (updateRates), so quotes are a few byte loads. Entries are
+// written under reservationLock and read without it.
+struct RateTable
+{
+    uint8_t discountPercent[ROOM_TYPE_COUNT][CALENDAR_DAYS] = {{0}}; // Discount for one night (0-100 %)
+};
+
+// Money. Every amount is an integer number of cents and every stay is
+// priced by one formula (priceStay, with its room type's policy), so
+// listings, totals and reports agree to the cent. Reports price many
+// reservations at once with priceReservations, which runs eight stays
+// per step with AVX2 where the CPU has it.
+const int PRICE_BATCH = 4096;             // Reservations priced per kernel call in reports
+const int PRICE_KERNEL_SHARE = 8;         // Reports listing fewer than 1/8 of the slots price one by one
+
+// Concurrency. Nights are taken without locks: a booking thread first
+// takes the room's claim word with a CAS, checks that the nights are
+// still free and clears their calendar bits with atomic operations, so
+// two threads can never hold the same room on the same night. Calendar
+// reads (availability, random room picks) are plain atomic loads and
+// never wait. Reservation records, the ID and name indexes and the
+// journal are guarded by reservationLock: writers hold it exclusively
+// for the few stores of one booking, lookups share it.
+// The guarantee is therefore weaker than "readers never block writers".
+// Availability never blocks a booking, but the commit of a booking or
+// cancellation waits until every lookup that holds reservationLock is
+// done. Reports, exports, summaries and revenue hold it for a whole scan.
+// Lookups that arrive while a writer waits may queue behind it as well
+// (shared_mutex makes no fairness promise either way).
+
+// Random numbers come from one engine per thread, so booking threads
+// never contend on generator state. Each engine is seeded from the
+// program seed and the order in which its thread first draws.
+unsigned int randomSeed = 0;            // Program seed (--seed)
+atomic<unsigned int> randomStreams{0};  // Thread engines seeded so far
+thread_local mt19937 randomEngine;      // This thread's engine
+thread_local bool randomEngineSeeded = false;
+
+// Write-ahead journal of booking events, kept in a data directory next
+// to the latest snapshot. Records are buffered and written with one
+// fsync per group; every record carries a sequence number (LSN) so that
+// replay can skip what the snapshot already holds.
+struct Journal
+{
+    int fd = -1;                  // Journal file (-1 = journaling off)
+    string directory;             // Data directory
+    string pending;               // Encoded records not yet written
+    int pendingRecords = 0;       // Number of records in pending
+    uint64_t nextLsn = 1;         // Sequence number of the next record
+    uint64_t sinceSnapshot = 0;   // Records written since the last snapshot
+    bool replaying = false;       // True during recovery (nothing is logged)
+};
+
+// Journal record kinds. Records keep the original encoding of money
+// (prices as EUR doubles, discounts as rates); replay converts to cents.
+const uint8_t JOURNAL_LAYOUT = 1;    // Single/double layout (journals of older releases)
+const uint8_t JOURNAL_BOOK = 2;      // Reservation committed
+const uint8_t JOURNAL_CANCEL = 3;    // Reservation cancelled
+const uint8_t JOURNAL_ROOM_TYPES = 4; // Rooms and price per room type (first record of a new hotel)
+const uint8_t JOURNAL_MODIFY = 5;     // Reservation moved to another room or stay
+
+const int JOURNAL_GROUP_COMMIT = 512;     // Records per write + fsync
+const uint64_t SNAPSHOT_INTERVAL = 100000; // Records between snapshots
+
+// One property: its rooms, bookings, indexes and journal. The functions
+// below work on the hotel the calling thread is bound to ('hotel').
+// Outside chain mode every thread uses the same hotel; in chain mode a
+// property is only ever touched by the worker thread that owns it.
+struct Hotel
+{
+    int propertyId = 0;           // Chain property ID (0 outside chain mode)
+    string city;                  // Chain city (empty outside chain mode)
+    RoomStore roomStore;          // Collection of all rooms
+    ReservationStore reservationStore; // All reservation slots, active or not
+    int totalRooms = 0;           // Total number of rooms in hotel
+    int firstRoomOfType[ROOM_TYPE_COUNT + 1] = {0}; // Room index where each type starts (+ end)
+    IdAllocator idAllocator;      // Source of all reservation IDs
+    unordered_map<int, int> reservationIndex; // Reservation ID -> slot in reservations
+    NameIndex nameIndex;          // Guest-name search index over active reservations
+    Calendar calendar;            // Availability of every room for every night
+    HotelTotals totals;           // Occupancy and revenue aggregates
+    RateTable rates;              // Demand discounts derived from totals
+    Journal journal;              // Durable log of all booking changes
+    shared_mutex reservationLock; // Guards reservationStore, indexes and journal
+    mutex idLock;                 // Guards idAllocator (taken after reservationLock)
+    mutex nameIndexBuildLock;     // Lets one reader build the lazy name index
+};
+
+Hotel singleHotel;                        // The hotel outside chain mode
+thread_local Hotel* hotel = &singleHotel; // Hotel the calling thread works on
+
+// Chain mode: many properties in one process. Each property is a shard
+// owned by one worker thread, and all work on it is queued to that
+// worker, so no lock spans the chain. Requests are routed by property
+// ID; city-wide queries are sent to every property in the city and the
+// answers merged.
+const char* const CHAIN_CITIES[] = {"vienna", "graz", "linz", "salzburg",
+                                    "innsbruck", "klagenfurt", "bregenz", "villach"};
+const int CHAIN_CITY_COUNT = 8;
+const unsigned int CHAIN_RANDOM_STREAM = 0x80000000u; // Worker k seeds stream base + k
+
+// Work for one property, run on the worker that owns it
+struct ChainTask
+{
+    Hotel* property;          // Hotel to bind while running
+    function<void()> run;     // The work itself
+    function<void()> finish; // Hands the result back (after the journal sync)
+};
+
+struct ChainWorker
+{
+    thread worker;             // Thread owning every property with (ID - 1) % workers == index
+    mutex queueLock;           // Guards tasks and stopping
+    condition_variable wake;   // Signalled when tasks arrive or on shutdown
+    vector<ChainTask> tasks;   // Queued work
+    bool stopping = false;     // Set once no more work will come
+};
+
+struct Chain
+{
+    vector<unique_ptr<Hotel>> properties;    // Property ID - 1 -> hotel
+    vector<unique_ptr<ChainWorker>> workers; // Worker threads
+};
+
+Chain chain; // Empty unless running in chain mode
+
+/**
+ * Queues work for a property on the worker thread that owns it
+ * @param propertyId Property (1-based, must exist)
+ * @param work Callable returning Result, run with 'hotel' bound to the property
+ * @return Future holding the result once the property's journal is synced
+ */
+template <typename Result, typename Work>
+future<Result> onProperty(int propertyId, Work work)
+{
+    auto result = make_shared<Result>();
+    auto done = make_shared<promise<Result>>();
+    future<Result> answer = done->get_future();
+    
+    ChainWorker& owner = *chain.workers[(propertyId - 1) % chain.workers.size()];
+    {
+        lock_guard<mutex> lock(owner.queueLock);
+        owner.tasks.push_back({chain.properties[propertyId - 1].get(),
+                               [result, work] { *result = work(); },
+                               [result, done] { done->set_value(move(*result)); }});
+    }
+    owner.wake.notify_one();
+    return answer;
+}
+
+// Binary snapshot (DIR/hotel.snapshot). A fixed header is followed by
+// sections holding the in-memory columns byte for byte, each starting
+// on an 8-byte boundary. Loading maps the file and copies each section
+// into its column in one block; nothing is parsed. Native byte order.
+enum SnapshotSection
+{
+    SNAP_ROOM_TYPE,       // uint8_t per room
+    SNAP_ROOM_PRICE,      // int32_t per room (cents)
+    SNAP_CALENDAR,        // uint64_t, CALENDAR_DAYS rows of wordsPerDay
+    SNAP_RES_STATUS,      // uint8_t per reservation
+    SNAP_RES_ROOM,        // int32_t per reservation
+    SNAP_RES_ARRIVAL,     // int16_t per reservation
+    SNAP_RES_NIGHTS,      // uint8_t per reservation
+    SNAP_RES_ID,          // int32_t per reservation
+    SNAP_RES_DISCOUNT,    // uint8_t per reservation (percent)
+    SNAP_RES_GUEST,       // uint32_t per reservation, index of its guest name
+    SNAP_GUEST_LENGTH,    // uint32_t per distinct guest name
+    SNAP_GUEST_HEAP,      // Distinct guest names, back to back
+    SNAPSHOT_SECTIONS
+};
+
+const char SNAPSHOT_MAGIC[8] = {'H', 'O', 'T', 'E', 'L', 'S', 'N', 'P'};
+const uint32_t SNAPSHOT_VERSION = 4; // 2: prices in cents, discounts in percent; 3: interned names; 4: room type table
+
+struct SnapshotHeader
+{
+    char magic[8];                          // SNAPSHOT_MAGIC
+    uint32_t version;                       // SNAPSHOT_VERSION
+    uint32_t headerSize;                    // sizeof(SnapshotHeader)
+    uint64_t lastLsn;                       // Last journal record included
+    uint64_t fileSize;                      // Total size, to detect truncation
+    int32_t totalRooms;                     // Hotel layout
+    int32_t roomTypeCount;                  // ROOM_TYPE_COUNT when written
+    int32_t calendarDays;                   // CALENDAR_DAYS when written
+    int32_t wordsPerDay;                    // Calendar row length
+    uint64_t reservationCount;              // Reservations stored (all active)
+    uint64_t guestNameCount;                // Distinct guest names stored
+    uint64_t guestHeapSize;                 // Bytes in the string heap
+    uint64_t sectionOffset[SNAPSHOT_SECTIONS]; // File offset of each section
+    uint32_t headerChecksum;                // Checksum of everything above
+    uint32_t reserved;                      // Keeps the size a multiple of 8
+};
+
+// Appends a value to a record in native byte order
+template <typename T>
+void putValue(string& buffer, T value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Reads a value written by putValue and advances the read position
+template <typename T>
+T getValue(const char*& pos)
+{
+    T value;
+    memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+
+// One client of the server mode. Requests are batch commands, one per
+// line, and may be pipelined; each reply is sent as "<length>\n"
+// followed by that many bytes of command output, in request order.
+struct Connection
+{
+    int fd = -1;            // Client socket
+    string input;           // Received bytes not yet forming a full line
+    string output;          // Replies not yet sent
+    size_t outputSent = 0;  // Bytes of output already sent
+    bool wantsWrite = false; // Registered for EPOLLOUT
+    bool inputClosed = false; // Client shut down its side; close once replies are sent
+};
+
+const size_t MAX_REQUEST_BYTES = 65536; // Longer lines close the connection
+const int MAX_EVENTS = 256;             // epoll events handled per wakeup
+
+volatile sig_atomic_t stopServer = 0; // Set by SIGINT/SIGTERM
+
+// Operation metrics. Each thread counts into its own histograms, so the
+// hot path never writes a shared cache line; readers merge all threads.
+// Latencies are recorded in CPU timestamp ticks (a few ns to read, where
+// chrono::steady_clock costs tens) and converted when the metrics are
+// read. Buckets are log-linear as in HDR histograms: 16 per power of
+// two, so a bucket's bounds are within 6.25% of any value recorded in it.
+enum MetricOperation
+{
+    METRIC_MAKE_RESERVATION,        // makeReservation (confirmation onwards)
+    METRIC_SEARCH_RESERVATION,      // searchReservation and batch searches (after input)
+    METRIC_VIEW_RESERVATIONS,       // viewReservations and other reports (writeReservationReport)
+    METRIC_DISPLAY_AVAILABLE_ROOMS, // displayAvailableRooms
+    METRIC_BOOK_ROOM,               // bookRoom
+    METRIC_RESERVE_ROOM,            // reserveRoom (batch, server and load bookings)
+    METRIC_RESERVE_BLOCK,           // reserveRoomBlock (group bookings)
+    METRIC_CANCEL_RESERVATION,      // cancelReservation
+    METRIC_MODIFY_RESERVATION,      // modifyReservation
+    METRIC_OPERATIONS
+};
+
+const char* const METRIC_NAMES[METRIC_OPERATIONS] = {
+    "make_reservation", "search_reservation", "view_reservations",
+    "display_available_rooms", "book_room", "reserve_room", "reserve_block", "cancel_reservation",
+    "modify_reservation"};
+
+const int METRIC_SUB_BUCKETS = 16;                            // Buckets per power of two
+const int METRIC_BUCKETS = (64 - 3) * METRIC_SUB_BUCKETS;     // Covers every uint64_t tick count
+
+// One thread's counts. Only the owning thread writes; readers use
+// atomic loads, so the writer needs no lock-prefixed instructions.
+struct ThreadMetrics
+{
+    uint64_t calls[METRIC_OPERATIONS] = {0};       // Completed operations (set by mergeMetrics)
+    uint64_t totalTicks[METRIC_OPERATIONS] = {0};  // Sum of their latencies
+    uint64_t buckets[METRIC_OPERATIONS][METRIC_BUCKETS] = {{0}}; // Latency histogram
+};
+
+mutex metricsLock;                      // Guards metricsRegistry
+vector<ThreadMetrics*> metricsRegistry; // Every thread's metrics (kept after the thread exits)
+thread_local ThreadMetrics* threadMetrics = nullptr; // This thread's entry, once registered
+
+// Times one operation, from construction to the end of its scope
+struct OperationTimer
+{
+    int operation;        // MetricOperation
+    uint64_t startTicks;  // Construction time (metricTicks)
+    explicit OperationTimer(int metricOperation);
+    ~OperationTimer();
+};
+
+// Periodic export of the metrics in Prometheus text format (--stats-file)
+struct StatsDump
+{
+    string path;               // Output file ("" = off)
+    int intervalSeconds = 10;  // Time between dumps
+    thread writer;             // Dump thread
+    mutex lock;                // Guards stopping
+    condition_variable wake;   // Signalled on shutdown
+    bool stopping = false;     // Set by stopStatsDump
+};
+
+StatsDump statsDump; // Periodic metrics file
+
+// Load generator (--load). Operations are drawn by weight; guest names
+// and the reservations looked up or cancelled are Zipf-distributed, so
+// a few guests and recent bookings are hot. Runs are reproducible for
+// a given --seed.
+enum LoadOperation
 {
-    int number;           // Room number
-    bool isSingle;        // true = single room, false = double room
-    bool isBooked;        // Booking status
-    int reservationId;    // Unique reservation ID
-    string guestName;     // Name of the guest
-    int nights;           // Number of nights stayed
-    double basePrice;     // Price per night
-    double discountRate;  // Applied discount rate
-    bool includesBreakfast; // True if BF included
+    LOAD_BOOK,        // reserveRoom (the makeReservation path)
+    LOAD_SEARCH_ID,   // findReservationById (searchReservation by ID)
+    LOAD_SEARCH_NAME, // findReservationsByName (searchReservation by name)
+    LOAD_LIST,        // displayAvailableRooms
+    LOAD_CANCEL,      // cancelReservation
+    LOAD_OPERATIONS
 };
 
-// Global variables
-vector<Room> rooms;       // Collection of all rooms
-int totalRooms = 0;       // Total number of rooms in hotel
-int singleRoomsCount = 0; // Count of single rooms
-int doubleRoomsCount = 0; // Count of double rooms
+const char* const LOAD_OPERATION_NAMES[LOAD_OPERATIONS] = {
+    "book", "search-id", "search-name", "list", "cancel"};
+
+struct LoadConfig
+{
+    int rooms = 10000;            // Hotel size (split by room type share)
+    long operations = 1000000;    // Operations to run
+    int guestNames = 100000;      // Distinct guest names
+    double zipfSkew = 0.99;       // Zipf exponent for names and reservations
+    int mix[LOAD_OPERATIONS] = {40, 25, 20, 5, 10}; // Weight of each operation
+};
+
+// Reports (view, export). Records are formatted by hand into a reusable
+// per-thread buffer that is written out in large blocks, rather than
+// field by field through ostream formatting.
+enum ReportFormat
+{
+    REPORT_TEXT,  // The view listing
+    REPORT_CSV,   // A header line, then one line per reservation
+    REPORT_JSON   // An array of objects, one per line
+};
+
+// Which reservations a report lists, and which page of them
+struct ReportQuery
+{
+    int roomType = -1;        // Index into ROOM_TYPES (-1 = any)
+    int breakfast = -1;       // 1 = with breakfast, 0 = without (-1 = any)
+    int discountPercent = -1; // Exact discount (-1 = any)
+    int offset = 0;           // Matches skipped before the first one listed
+    int limit = -1;           // Matches listed at most (-1 = all)
+};
+
+const size_t REPORT_FLUSH_BYTES = 1 << 16; // Buffered output written per block
+const int REPORT_PAGE_SIZE = 20;           // Reservations per interactive page
+thread_local string reportBuffer;          // Formatting buffer, reused between reports
+
+// Bulk import of reservation feeds (batch command 'import'), in the
+// formats written by 'export'. The file is mapped and cut into one chunk
+// of whole lines per thread. The threads parse and check their lines and
+// take the nights of each stay in parallel, with the same claim as any
+// booking; the claimed records are then stored in file order, holding
+// reservationLock once per IMPORT_BATCH records.
+enum ImportField
+{
+    IMPORT_ROOM,          // Room number, or "any"/empty to assign one (optional)
+    IMPORT_TYPE,          // Room type name
+    IMPORT_GUEST,         // Guest name
+    IMPORT_ARRIVAL,       // First night
+    IMPORT_NIGHTS,        // Number of nights
+    IMPORT_BREAKFAST,     // yes/no or true/false (optional, default no)
+    IMPORT_DISCOUNT,      // Discount in percent (optional, default 0)
+    IMPORT_FIELDS
+};
+
+// Column (CSV header) or key (JSON) of each field; others are ignored
+const char* const IMPORT_FIELD_NAMES[IMPORT_FIELDS] = {
+    "room", "type", "guest", "arrival_day", "nights", "breakfast", "discount_percent"};
+
+// One record of a feed
+struct ImportRecord
+{
+    int line = 0;             // Line in the file (1-based)
+    int roomType = -1;        // Index into ROOM_TYPES
+    int roomNumber = 0;       // Room asked for (0 = any), then the room claimed
+    int arrivalDay = 0;       // First night (0 = tonight)
+    int nights = 0;           // Number of nights
+    int discountPercent = 0;  // Discount (0-100 %)
+    bool hasBreakfast = false; // True if breakfast was added
+    string guestName;         // Name of guest
+    const char* error = nullptr; // Why the record was refused (nullptr = booked)
+};
+
+// Outcome of one import
+struct ImportReport
+{
+    int records = 0;                        // Records read
+    int imported = 0;                       // Records booked
+    vector<pair<int, const char*>> refused; // (line, reason) of the others, in file order
+    string failure;                         // Why nothing was read ("" = file was read)
+};
+
+const int IMPORT_BATCH = 4096;               // Records stored per hold of reservationLock
+const size_t IMPORT_MIN_CHUNK = 1 << 18;     // Smallest chunk worth a thread of its own
+const int IMPORT_ERRORS_SHOWN = 20;          // Refused records listed in the reply
+
+/**
+ * Runs work on several threads, all bound to the calling thread's hotel
+ * @param threadCount Number of threads (the calling thread is one of them)
+ * @param work Callable taking the thread's index (0 to threadCount - 1)
+ */
+template <typename Work>
+void runInParallel(int threadCount, Work work)
+{
+    Hotel* property = hotel;
+    vector<thread> helpers;
+    for (int k = 1; k < threadCount; k++) {
+        helpers.emplace_back([property, &work, k] {
+            hotel = property;
+            work(k);
+        });
+    }
+    work(0);
+    for (thread& helper : helpers) {
+        helper.join();
+    }
+}
+
+// Destination for prompts and interactive error messages.
+// Batch mode points this at a stream without a buffer so prompts go nowhere.
+ostream nullStream(nullptr);
+ostream* promptOut = &cout;
 
 // 2. Function declarations
 void initializeRooms();
+void setupRooms(const int roomCounts[], const int32_t priceCents[]);
+void splitRooms(int roomCount, int roomCounts[]);
 void displayMainMenu();
-bool isRoomAvailable(int roomNumber, bool requireSingle);
+bool isRoomAvailable(int roomNumber, int roomType, int arrivalDay, int nights);
 int makeReservation();
-void viewReservations();
+void viewReservations(ostream& out = cout, const ReportQuery& query = ReportQuery());
+void browseReservations();
+int writeReservationReport(ostream& out, const ReportQuery& query, int format, int& listed);
+void appendReservation(string& buffer, int slot, int64_t total, int format, bool first);
+bool parseReportQuery(istream& args, ReportQuery& query);
+void appendNumber(string& buffer, int64_t value, int width = 0);
+void appendCents(string& buffer, int64_t cents);
+void appendQuoted(string& buffer, string_view text, int format);
+void flushReport(ostream& out, string& buffer);
 void searchReservation();
-void displayAvailableRooms();
-double calculateFinalPrice(int roomNumber, int nights, double discount);
+void changeReservation();
+void displayAvailableRooms(ostream& out = cout, int arrivalDay = 0, int nights = 1);
+int64_t calculateFinalPrice(int roomNumber, int arrivalDay, int nights, int discountPercent,
+                            bool hasBreakfast);
+void priceReservations(int firstSlot, int count, int64_t* totals);
+void priceReservationsScalar(int firstSlot, int count, int64_t* totals);
+void priceReservationsAvx2(int firstSlot, int count, int64_t* totals);
+int64_t totalRevenue(int& reservations);
+string formatCents(int64_t cents);
 int generateReservationId();
-double getRandomDiscount();
+void generateReservationIds(int count, int* reservationIds);
+int drawReservationId();
+void releaseReservationId(int reservationId);
+void openNextIdRange();
+int takeIdPosition(int pos);
+bool claimReservationId(int reservationId);
+void rebuildIdAllocator();
+int nightDiscount(int roomType, int day);
+void updateRates(int roomType, int firstDay, int endDay);
+void rebuildRates();
+int quoteDiscount(int roomType, int arrivalDay, int nights);
+int randomRoomType();
+int roomTypeNamed(const string& name);
+int chooseRoomType();
+double randomFraction();
+void seedRandom(unsigned int seed);
+int randomBelow(int bound);
+void seedThreadRandom(unsigned int stream);
 int getValidatedInput(const string& prompt, int min, int max);
 bool bookRoom(int roomNumber, const string& guestName, int nights);
+int assignRandomRoom(int roomType, int arrivalDay, int nights);
+bool claimRoomNights(int roomIndex, int arrivalDay, int nights);
+void acquireRoomClaim(int roomIndex);
+void releaseRoomClaim(int roomIndex);
+int commitReservation(int roomNumber, int reservationId, const string& guestName,
+                      int arrivalDay, int nights, int discountPercent, bool hasBreakfast);
+int storeReservation(int roomIndex, int reservationId, string_view guestName,
+                     int arrivalDay, int nights, int discountPercent, bool hasBreakfast);
+int reserveRoom(int roomType, int roomNumber, const string& guestName,
+                int arrivalDay, int nights, bool hasBreakfast);
+int findRoomBlock(int roomType, int roomCount, int arrivalDay, int nights);
+int reserveRoomBlock(int roomType, int roomCount, const string& guestName, int arrivalDay,
+                     int nights, bool hasBreakfast, vector<int>& reservationIds);
+bool cancelReservation(int reservationId);
+bool modifyReservation(int reservationId, int roomNumber, int arrivalDay, int nights);
+bool claimChangedNights(int roomIndex, int arrivalDay, int nights,
+                        int heldRoom, int heldArrival, int heldNights);
+int findReservationById(int reservationId);
+vector<int> findReservationsByName(const string& searchName);
+string foldName(string_view name);
+uint32_t trigramAt(string_view text, size_t pos);
+void indexGuestName(int slot);
+void postGuestName(int slot);
+void buildNameIndex();
+void unindexGuestName(int slot);
+int roomNumberOf(int roomIndex);
+int roomTypeOf(int roomIndex);
+int roomCountOfType(int roomType);
+int32_t roomBasePrice(int roomIndex);
+int reservationSlotCount();
+bool isActiveReservation(int slot);
+int reservationIdOf(int slot);
+int reservedRoomOf(int slot);
+int arrivalDayOf(int slot);
+int nightsOf(int slot);
+int discountOf(int slot);
+bool includesBreakfast(int slot);
+string_view guestNameOf(int slot);
+string_view foldedNameOf(int slot);
+void setGuestName(int slot, string_view guestName);
+uint32_t internGuestName(string_view name);
+void releaseGuestName(uint32_t handle);
+char* allocateGuestBytes(size_t size);
+void compactGuestNames();
+int allocateReservationSlot();
+void releaseReservationSlot(int slot);
+bool isValidStay(int arrivalDay, int nights);
+bool isRoomFreeFor(int roomIndex, int arrivalDay, int nights);
+void setRoomNights(int roomIndex, int arrivalDay, int nights, bool free);
+int freeRoomsMask(int roomType, int arrivalDay, int nights, vector<uint64_t>& mask);
+int nextSetBit(const vector<uint64_t>& mask, int fromIndex);
+int countSetBits(const vector<uint64_t>& mask);
+int selectSetBit(const vector<uint64_t>& mask, int rank);
+vector<int> sortedByRoom(vector<int> slots, size_t first = 0, size_t last = SIZE_MAX);
+int64_t reservationTotal(int slot);
+void addToTotals(int slot, int sign);
+void rebuildTotals();
+void writeSummary(ostream& out, int day);
+bool executeCommand(const string& line, ostream& out);
+void runBatch(istream& in);
+bool importReservations(const string& path, int format, ImportReport& report);
+int parseImportChunk(string_view text, int format, const int columns[], vector<ImportRecord>& records);
+bool splitCsvLine(string_view line, vector<string>& cells, int& cellCount);
+bool splitJsonLine(string_view line, string values[], bool present[]);
+size_t readJsonString(string_view line, size_t pos, string& value);
+const char* readImportRecord(const string* const values[], ImportRecord& record);
+bool parseImportNumber(string_view text, int& value);
+int claimRandomRoom(int roomType, int arrivalDay, int nights);
+int runServer(const string& address);
+int openListener(const string& address);
+void serveRequests(Connection& connection, ostringstream& reply);
+bool sendReplies(Connection& connection);
+bool executeRequest(const string& line, ostream& out);
+string fileCommandOf(const string& line);
+int runLoad(const LoadConfig& config);
+void recordLatency(int operation, uint64_t ticks);
+uint64_t metricTicks();
+double metricNanosPerTick();
+int metricBucket(uint64_t ticks);
+uint64_t metricBucketLimit(int bucket);
+void mergeMetrics(ThreadMetrics& total);
+void showStatistics(ostream& out = cout);
+void writeStatsText(ostream& out);
+void startStatsDump(const string& path, int intervalSeconds);
+void stopStatsDump();
+bool writeStatsFile();
+bool parseLoadMix(const string& text, LoadConfig& config);
+vector<double> zipfTable(int items, double skew);
+int zipfRank(const vector<double>& cumulative);
+bool startHotels(const string& dataDir, int chainSize, int workerCount);
+void stopHotels();
+bool startChain(int propertyCount, int workerCount, const string& dataDir);
+void runChainWorker(ChainWorker& worker, unsigned int index);
+void stopChain();
+bool executeChainCommand(const string& line, ostream& out);
+vector<pair<int, int>> freeRoomsInCity(const string& city, int roomType,
+                                       int arrivalDay, int nights);
+bool startHotel(const string& dataDir);
+bool recoverState(const string& dataDir);
+size_t replayRecords(const string& data, uint64_t afterLsn);
+bool applyJournalRecord(const char* payload, size_t length, uint64_t afterLsn);
+bool openJournal(const string& dataDir, bool freshHotel);
+void encodeLayout(string& out, uint64_t lsn);
+void encodeBook(string& out, uint64_t lsn, int slot);
+void appendRecord(string& out, const string& payload);
+void logJournalRecord(const string& payload);
+void syncJournal();
+void flushJournal();
+bool writeSnapshot();
+bool loadSnapshot(const string& path, uint64_t& lastLsn);
+void appendSection(string& image, SnapshotHeader& header, int section,
+                   const void* data, size_t size);
+void closeJournal();
+bool readWholeFile(const string& path, string& data);
+bool writeAll(int fd, const char* data, size_t size);
+uint32_t checksum(const char* data, size_t size);
 
 // 3. Main function
-int main() 
+int main(int argc, char* argv[])
 {
     // Seed random number generator with current time
-    srand(static_cast<unsigned int>(time(0)));
+    unsigned int seed = static_cast<unsigned int>(time(0));
+    bool batchMode = false;    // true = read commands instead of prompting
+    string batchFile;          // Command file for batch mode (empty = stdin)
+    string dataDir;            // Journal/snapshot directory (empty = no persistence)
+    string serveAddress;       // Port or Unix socket path for server mode
+    int chainSize = 0;         // Properties in chain mode (0 = one hotel)
+    int workerCount = max(1u, thread::hardware_concurrency()); // Chain worker threads
+    bool loadMode = false;     // true = run the load generator
+    LoadConfig load;           // Load generator settings
+    string statsFile;          // Prometheus metrics file (empty = none)
+    int statsInterval = 10;    // Seconds between metrics dumps
+
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--batch") {
+            batchMode = true;
+            if (i + 1 < argc && argv[i+1][0] != '-') {
+                batchFile = argv[++i];
+            }
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--data-dir" && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (arg == "--chain" && i + 1 < argc) {
+            chainSize = max(1, atoi(argv[++i]));
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workerCount = max(1, atoi(argv[++i]));
+        } else if (arg == "--stats-file" && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (arg == "--stats-interval" && i + 1 < argc) {
+            statsInterval = max(1, atoi(argv[++i]));
+        } else if (arg == "--load") {
+            loadMode = true;
+        } else if (arg == "--rooms" && i + 1 < argc) {
+            load.rooms = max(1, atoi(argv[++i]));
+        } else if (arg == "--ops" && i + 1 < argc) {
+            load.operations = max(1L, atol(argv[++i]));
+        } else if (arg == "--names" && i + 1 < argc) {
+            load.guestNames = max(1, atoi(argv[++i]));
+        } else if (arg == "--zipf" && i + 1 < argc) {
+            load.zipfSkew = max(0.0, atof(argv[++i]));
+        } else if (arg == "--mix" && i + 1 < argc && parseLoadMix(argv[++i], load)) {
+            // Weights parsed
+        } else {
+            cerr << "Usage: " << argv[0] << " [--batch [file] | --serve PORT|SOCKET]"
+                 << " [--seed N] [--data-dir DIR] [--chain PROPERTIES [--workers N]]"
+                 << " [--stats-file FILE [--stats-interval SECONDS]]\n"
+                 << "       " << argv[0] << " --load [--rooms N] [--ops N] [--names N] [--zipf S]"
+                 << " [--mix book:40,search-id:25,search-name:20,list:5,cancel:10] [--seed N]\n";
+            return 1;
+        }
+    }
+    seedRandom(seed);
+    startStatsDump(statsFile, statsInterval);
+    
+    if (loadMode) {
+        promptOut = &nullStream;
+        int status = runLoad(load);
+        stopStatsDump();
+        return status;
+    }
     
+    if (chainSize > 0 && !batchMode && serveAddress.empty()) {
+        cerr << "Error: --chain needs --batch or --serve\n";
+        return 1;
+    }
+
+    if (!serveAddress.empty()) {
+        // Same commands as batch mode, answered over a socket
+        promptOut = &nullStream;
+        if (!startHotels(dataDir, chainSize, workerCount)) {
+            return 1;
+        }
+        int status = runServer(serveAddress);
+        stopHotels();
+        return status;
+    }
+
+    if (batchMode) {
+        // No prompts, no echo: only command results are written to stdout
+        ios::sync_with_stdio(false);
+        promptOut = &nullStream;
+        if (!startHotels(dataDir, chainSize, workerCount)) {
+            return 1;
+        }
+
+        if (batchFile.empty()) {
+            runBatch(cin);
+        } else {
+            ifstream in(batchFile);
+            if (!in) {
+                cerr << "Error: cannot open " << batchFile << "\n";
+                stopHotels();
+                return 1;
+            }
+            runBatch(in);
+        }
+        stopHotels();
+        return 0;
+    }
+
     cout << "========================================\n";
     cout << "      HOTEL ROOM RESERVATION SYSTEM\n";
     cout << "========================================\n\n";
     
-    // Initialize hotel rooms with random configuration
-    initializeRooms();
+    // Initialize hotel rooms (random configuration unless recovered)
+    if (!startHotel(dataDir)) {
+        return 1;
+    }
     
     int choice;                // User's menu choice
     bool continueProgram = true; // Control program loop
@@ -68,7 +1021,7 @@ int main()
     // Main program loop
     while (continueProgram) {
         displayMainMenu();                         
-        choice = getValidatedInput("Enter your choice (1-5): ", 1, 5);
+        choice = getValidatedInput("Enter your choice (1-7): ", 1, 7);
         
         // Process user choice
         switch (choice) {
@@ -76,21 +1029,37 @@ int main()
                 makeReservation();    // Create new reservation
                 break;
             case 2:
-                viewReservations();   // Display all current reservations
+                browseReservations(); // Display current reservations, a page at a time
                 break;
             case 3:
                 searchReservation();  // Search for specific reservation
                 break;
-            case 4:
-                displayAvailableRooms(); // Show available rooms
+            case 4: {
+                // Show rooms available for a range of nights
+                int arrivalDay = getValidatedInput("Enter arrival day (0 = today, max " +
+                                                   to_string(CALENDAR_DAYS - 1) + "): ", 0, CALENDAR_DAYS - 1);
+                int maxNights = min(MAX_NIGHTS, CALENDAR_DAYS - arrivalDay);
+                int nights = getValidatedInput("Enter number of nights (1-" + to_string(maxNights) + "): ", 1, maxNights);
+                displayAvailableRooms(cout, arrivalDay, nights);
                 break;
+            }
             case 5:
+                showStatistics();     // Operation counts and latencies
+                break;
+            case 6:
+                changeReservation();  // Cancel, or change nights or room
+                break;
+            case 7:
                 cout << "\nThank you for using the Hotel Reservation System!\n";
                 continueProgram = false; // Exit program
                 break;
         }
+        
+        // Make every confirmed change durable before the next prompt
+        syncJournal();
     }
     
+    stopHotels();
     return 0;
 }
 
@@ -99,53 +1068,102 @@ int main()
 /**
  * Initializes all rooms in the hotel with random configuration
  * - Random total rooms (40-300, even number)
- * - Equal split between single and double rooms
- * - Random pricing within specified ranges
+ * - Split between the room types by their share
+ * - Random pricing within each type's range
  */
 void initializeRooms() 
 {
     // Generate random even number between 40 and 300
-    totalRooms = 40 + 2 * (rand() % 131); // (300-40)/2 = 130, +1 for inclusive range
-    if (totalRooms % 2 != 0) totalRooms++; // Ensure even number
-    
-    // Split equally between single and double rooms
-    singleRoomsCount = totalRooms / 2;
-    doubleRoomsCount = totalRooms / 2;
+    int roomCount = 40 + 2 * randomBelow(131); // (300-40)/2 = 130, +1 for inclusive range
     
-    // Generate random base prices
-    int singleBasePrice = 80 + rand() % 21;   // Random price: 80-100 EUR
-    int doubleBasePrice = 120 + rand() % 31;  // Random price: 120-150 EUR
+    int roomCounts[ROOM_TYPE_COUNT];
+    int32_t priceCents[ROOM_TYPE_COUNT];
+    splitRooms(roomCount, roomCounts);
     
     // Display initialization details
-    cout << "Initializing hotel with " << totalRooms << " rooms...\n";
-    cout << "Single rooms: " << singleRoomsCount 
-         << " (Price: " << singleBasePrice << " EUR/night)\n";
-    cout << "Double rooms: " << doubleRoomsCount 
-         << " (Price: " << doubleBasePrice << " EUR/night)\n\n";
+    *promptOut << "Initializing hotel with " << roomCount << " rooms...\n";
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        const RoomTypeInfo& info = ROOM_TYPES[t];
+        int basePrice = info.minPriceEur + randomBelow(info.maxPriceEur - info.minPriceEur + 1);
+        priceCents[t] = basePrice * 100;
+        *promptOut << info.label << " rooms: " << roomCounts[t]
+                   << " (Price: " << basePrice << " EUR/night)\n";
+    }
+    *promptOut << "\n";
+    
+    setupRooms(roomCounts, priceCents);
+    
+    *promptOut << "Room initialization completed successfully!\n\n";
+}
+
+/**
+ * Splits a number of rooms between the room types by their share
+ * (largest remainder, so the counts add up to roomCount)
+ * @param roomCount Total number of rooms
+ * @param roomCounts Receives the number of rooms of each type
+ */
+void splitRooms(int roomCount, int roomCounts[])
+{
+    int assigned = 0;
+    int remainder[ROOM_TYPE_COUNT];
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        roomCounts[t] = roomCount * ROOM_TYPES[t].sharePercent / 100;
+        remainder[t] = roomCount * ROOM_TYPES[t].sharePercent % 100;
+        assigned += roomCounts[t];
+    }
+    while (assigned < roomCount) {
+        int largest = int(max_element(remainder, remainder + ROOM_TYPE_COUNT) - remainder);
+        roomCounts[largest]++;
+        remainder[largest] = -1;
+        assigned++;
+    }
+}
+
+/**
+ * Builds an empty hotel with a given layout. Rooms are numbered by
+ * type, in ROOM_TYPES order: the first roomCounts[0] rooms have type 0.
+ * @param roomCounts Number of rooms of each type
+ * @param priceCents Price per night of each type, in cents
+ */
+void setupRooms(const int roomCounts[], const int32_t priceCents[])
+{
+    hotel->totalRooms = 0;
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        hotel->firstRoomOfType[t] = hotel->totalRooms;
+        hotel->totalRooms += roomCounts[t];
+    }
+    hotel->firstRoomOfType[ROOM_TYPE_COUNT] = hotel->totalRooms;
+    
+    // Resize columns to hold all rooms
+    hotel->roomStore.type.assign(hotel->totalRooms, SINGLE_ROOM);
+    hotel->roomStore.basePriceCents.assign(hotel->totalRooms, 0);
+    hotel->roomStore.claim.assign(hotel->totalRooms, 0);
+    hotel->reservationStore = ReservationStore();
+    hotel->reservationIndex.clear();
+    hotel->idAllocator = IdAllocator();
+    hotel->nameIndex = NameIndex();
+    hotel->totals = HotelTotals();
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        hotel->totals.bookedPerDay[t].assign(CALENDAR_DAYS, 0);
+    }
+    rebuildRates();
     
-    // Resize vector to hold all rooms
-    rooms.resize(totalRooms);
+    // Every room starts out free on every night
+    hotel->calendar.wordsPerDay = (hotel->totalRooms + 63) / 64;
+    hotel->calendar.freeBits.assign(size_t(CALENDAR_DAYS) * hotel->calendar.wordsPerDay, 0);
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        hotel->calendar.typeMask[t].assign(hotel->calendar.wordsPerDay, 0);
+    }
     
     // Initialize each room
-    for (int i = 0; i < totalRooms; i++) {
-        rooms[i].number = i + 1;           // Room numbers start from 1
-        rooms[i].isBooked = false;         // Initially not booked
-        rooms[i].reservationId = 0;        // No reservation yet
-        rooms[i].nights = 0;               // No nights booked
-        rooms[i].includesBreakfast = false; // Not book breakfast
-        rooms[i].discountRate = 0.0;       // Initialize discount rate
-
-        // First half: single rooms, second half: double rooms
-        if (i < singleRoomsCount) {
-            rooms[i].isSingle = true;      // Single room
-            rooms[i].basePrice = singleBasePrice;
-        } else {
-            rooms[i].isSingle = false;     // Double room
-            rooms[i].basePrice = doubleBasePrice;
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        for (int i = hotel->firstRoomOfType[t]; i < hotel->firstRoomOfType[t+1]; i++) {
+            hotel->roomStore.type[i] = static_cast<uint8_t>(t);
+            hotel->roomStore.basePriceCents[i] = priceCents[t];
+            hotel->calendar.typeMask[t][i / 64] |= uint64_t(1) << (i % 64);
+            setRoomNights(i, 0, CALENDAR_DAYS, true);
         }
     }
-    
-    cout << "Room initialization completed successfully!\n\n";
 }
 
 // Displays the main menu with all available options
@@ -156,35 +1174,46 @@ void displayMainMenu() {
     cout << "2. View all reservations\n";
     cout << "3. Search for a reservation\n";
     cout << "4. Display available rooms\n";
-    cout << "5. Exit program\n";
+    cout << "5. Show statistics\n";
+    cout << "6. Cancel or change a reservation\n";
+    cout << "7. Exit program\n";
     cout << "===================================\n";
 }
 
 // Checks if a room is available for booking
 // @param roomNumber The room number to check
-// @param requireSingle If true, checks for single room specifically
+// @param roomType Room type the room must have (-1 = any)
+// @param arrivalDay First night of the stay (0 = tonight)
+// @param nights Number of nights of the stay
 // @return True if room is available, false otherwise
 
-bool isRoomAvailable(int roomNumber, bool requireSingle = false) 
+bool isRoomAvailable(int roomNumber, int roomType, int arrivalDay, int nights) 
 {
     // Validate room number range
-    if (roomNumber < 1 || roomNumber > totalRooms) 
+    if (roomNumber < 1 || roomNumber > hotel->totalRooms) 
     {
-        cout << "Error: Invalid room number!\n";
+        *promptOut << "Error: Invalid room number!\n";
         return false;
     }
     
     // Check if room type matches requirement
-    if (requireSingle && !rooms[roomNumber-1].isSingle) 
+    if (roomType != -1 && roomTypeOf(roomNumber-1) != roomType) 
+    {
+        *promptOut << "Error: Room " << roomNumber << " is not a " << ROOM_TYPES[roomType].name << " room!\n";
+        return false;
+    }
+    
+    // Check that the stay fits in the booking horizon
+    if (!isValidStay(arrivalDay, nights)) 
     {
-        cout << "Error: Room " << roomNumber << " is not a single room!\n";
+        *promptOut << "Error: Stay must end within " << CALENDAR_DAYS << " days!\n";
         return false;
     }
     
-    // Check if room is already booked
-    if (rooms[roomNumber-1].isBooked) 
+    // Check if room is already booked on any of those nights
+    if (!isRoomFreeFor(roomNumber-1, arrivalDay, nights)) 
     {
-        cout << "Error: Room " << roomNumber << " is already booked!\n";
+        *promptOut << "Error: Room " << roomNumber << " is already booked for those nights!\n";
         return false;
     }
     
@@ -198,15 +1227,17 @@ int makeReservation() {
     cout << "\n======== NEW RESERVATION ========\n";
     
     // Select room type
-    cout << "Select room type:\n";
-    cout << "1. Single room (1 person)\n";
-    cout << "2. Double room (2 persons)\n";
+    int roomType = chooseRoomType();
+    const PricingPolicy& policy = ROOM_TYPES[roomType].pricing;
     
-    int roomTypeChoice = getValidatedInput("Enter choice (1-2): ", 1, 2);
-    bool requireSingle = (roomTypeChoice == 1); // true for single, false for double
+    // Get stay dates
+    int arrivalDay = getValidatedInput("Enter arrival day (0 = today, max " +
+                                       to_string(CALENDAR_DAYS - 1) + "): ", 0, CALENDAR_DAYS - 1);
+    int maxNights = min(MAX_NIGHTS, CALENDAR_DAYS - arrivalDay);
+    int nights = getValidatedInput("Enter number of nights (1-" + to_string(maxNights) + "): ", 1, maxNights);
     
-    // Show currently available rooms
-    displayAvailableRooms();
+    // Show rooms available for those nights
+    displayAvailableRooms(cout, arrivalDay, nights);
     
     // Choose booking method
     cout << "\nBooking method:\n";
@@ -219,35 +1250,25 @@ int makeReservation() {
     
     if (bookingMethod == 1) 
     {
-        // Collect all available rooms of required type
-        vector<int> availableRooms;
-        for (int i = 0; i < totalRooms; i++) {
-            if (!rooms[i].isBooked) { // Room is not booked
-                if ((requireSingle && rooms[i].isSingle) || 
-                    (!requireSingle && !rooms[i].isSingle)) {
-                    availableRooms.push_back(i + 1); // Add to available list
-                }
-            }
-        }
+        // Randomly select from available rooms of required type
+        selectedRoom = assignRandomRoom(roomType, arrivalDay, nights);
         
         // Check if any rooms are available
-        if (availableRooms.empty()) 
+        if (selectedRoom == -1) 
         {
             cout << "No available rooms of selected type!\n";
             return -1; // Reservation failed
         }
         
-        // Randomly select from available rooms
-        selectedRoom = availableRooms[rand() % availableRooms.size()];
         cout << "System assigned room: " << selectedRoom << "\n";
         
     } else {
         // Manual room selection
-        selectedRoom = getValidatedInput("Enter room number to book (1-" + to_string(totalRooms) + "): ", 1, totalRooms);
+        selectedRoom = getValidatedInput("Enter room number to book (1-" + to_string(hotel->totalRooms) + "): ", 1, hotel->totalRooms);
     }
     
     // Validate room availability
-    if (!isRoomAvailable(selectedRoom, requireSingle)) {
+    if (!isRoomAvailable(selectedRoom, roomType, arrivalDay, nights)) {
         return -1; // Reservation failed
     }
     
@@ -257,28 +1278,24 @@ int makeReservation() {
     string guestName;
     getline(cin, guestName);
     
-    // Get number of nights
-    int nights = getValidatedInput("Enter number of nights (1-30): ", 1, 30);
-    
-    // Apply random discount
-    double discount = getRandomDiscount();
+    // Discount from the current demand for those nights
+    int discount = quoteDiscount(roomType, arrivalDay, nights);
     
-    // Calculate final price
-    double finalPrice = calculateFinalPrice(selectedRoom, nights, discount);
-    
-    // Book breakfast to get 5% off of total price
-    cout << "\nAdd breakfast to reservation? (5% discount on total price)\n";
-    cout << "1. Yes, include breakfast (5% discount)\n";
+    // Book breakfast to get the room type's breakfast discount off the total
+    cout << "\nAdd breakfast to reservation? (" << policy.breakfastDiscountPercent
+         << "% discount on total price)\n";
+    cout << "1. Yes, include breakfast (" << policy.breakfastDiscountPercent << "% discount)\n";
     cout << "2. No, skip breakfast\n";
     int breakfastChoice = getValidatedInput("Enter choice (1-2): ", 1, 2);
     bool hasBreakfast = (breakfastChoice == 1);
 
-    // Apply 5% if booking breakfast
     if (hasBreakfast) {
-        finalPrice = finalPrice * 0.95; // Apply 5% discount
         cout << "Breakfast discount applied!\n";
     }
     
+    // Calculate final price (room, season, discounts and breakfast in one step)
+    int64_t finalPrice = calculateFinalPrice(selectedRoom, arrivalDay, nights, discount, hasBreakfast);
+    
     // Generate unique reservation ID
     int reservationId = generateReservationId();
     
@@ -286,13 +1303,22 @@ int makeReservation() {
     cout << "\n======== RESERVATION SUMMARY ========\n";
     cout << "Reservation ID: " << reservationId << "\n";
     cout << "Guest: " << guestName << "\n";
-    cout << "Room: " << selectedRoom << " (" 
-         << (rooms[selectedRoom-1].isSingle ? "Single" : "Double") << ")\n";
+    cout << "Room: " << selectedRoom << " (" << ROOM_TYPES[roomType].label << ")\n";
+    cout << "Arrival: day " << arrivalDay << "\n";
     cout << "Nights: " << nights << "\n";
-    cout << "Base price: " << rooms[selectedRoom-1].basePrice << " EUR/night\n";
-    cout << "Discount: " << (discount * 100) << "%\n";
-    cout << "Breakfast: " << (hasBreakfast ? "Yes (5% discount applied)" : "No") << "\n";
-    cout << "Total price: " << fixed << setprecision(2) << finalPrice << " EUR\n";
+    cout << "Base price: " << formatCents(roomBasePrice(selectedRoom-1)) << " EUR/night\n";
+    cout << "Discount: " << discount << "%";
+    if (nights >= policy.longStayNights) {
+        cout << " + " << policy.longStayDiscountPercent << "% long stay";
+    }
+    cout << "\n";
+    cout << "Breakfast: ";
+    if (hasBreakfast) {
+        cout << "Yes (" << policy.breakfastDiscountPercent << "% discount applied)\n";
+    } else {
+        cout << "No\n";
+    }
+    cout << "Total price: " << formatCents(finalPrice) << " EUR\n";
     cout << "====================================\n";
     
     // Confirm reservation
@@ -302,13 +1328,15 @@ int makeReservation() {
     
     if (confirm == 1) 
     {
+        OperationTimer timer(METRIC_MAKE_RESERVATION);
+        
         // Update room booking information
-        rooms[selectedRoom-1].isBooked = true;
-        rooms[selectedRoom-1].reservationId = reservationId;
-        rooms[selectedRoom-1].guestName = guestName;
-        rooms[selectedRoom-1].nights = nights;
-        rooms[selectedRoom-1].discountRate = discount;
-        rooms[selectedRoom-1].includesBreakfast = hasBreakfast; // Save breakfast choice
+        if (commitReservation(selectedRoom, reservationId, guestName, arrivalDay, nights,
+                              discount, hasBreakfast) == -1) {
+            releaseReservationId(reservationId);
+            cout << "\nSorry, room " << selectedRoom << " was booked by someone else in the meantime.\n";
+            return -1;
+        }
         
         cout << "\nReservation confirmed!\n";
         cout << "Your reservation ID is: " << reservationId << "\n";
@@ -316,47 +1344,66 @@ int makeReservation() {
         
         return reservationId; // Return successful reservation ID
     } else {
+        releaseReservationId(reservationId); // ID was never used
         cout << "Reservation cancelled.\n";
         return -1; // Reservation cancelled
     }
 }
 
-// Displays all current reservations in the hotel
+// Displays current reservations in the hotel
+// @param out Stream receiving the listing
+// @param query Filters and page (default: every reservation, with the summary)
 
-void viewReservations() {
-    cout << "\n======== ALL RESERVATIONS ========\n";
+void viewReservations(ostream& out, const ReportQuery& query) {
+    out << "\n======== ALL RESERVATIONS ========\n";
+    shared_lock<shared_mutex> lock(hotel->reservationLock);
     
-    bool hasReservations = false; // Flag to check if any reservations exist
+    int listed = 0;
+    int matched = writeReservationReport(out, query, REPORT_TEXT, listed);
+    bool everything = query.roomType == -1 && query.breakfast == -1 &&
+                      query.discountPercent == -1 && query.offset == 0 && query.limit == -1;
+    if (everything) {
+        if (matched > 0) writeSummary(out, 0);
+    } else if (listed > 0) {
+        out << "Showing " << query.offset + 1 << "-" << query.offset + listed
+            << " of " << matched << " reservations\n";
+    }
+}
+
+// Displays current reservations a page at a time, optionally one room type only
+
+void browseReservations() {
+    cout << "\n======== ALL RESERVATIONS ========\n";
+    cout << "Show:\n";
+    cout << "1. All reservations\n";
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        cout << t + 2 << ". " << ROOM_TYPES[t].label << " rooms only\n";
+    }
+    int typeChoice = getValidatedInput("Enter choice (1-" + to_string(ROOM_TYPE_COUNT + 1) + "): ",
+                                       1, ROOM_TYPE_COUNT + 1);
     
-    for (int i = 0; i < totalRooms; i++) {
-        if (rooms[i].isBooked) {
-            hasReservations = true;
-            double finalPrice = calculateFinalPrice(i+1, rooms[i].nights, rooms[i].discountRate);
-            
-            // Apply breakfast discount
-            if (rooms[i].includesBreakfast)
-            {
-                finalPrice = finalPrice * 0.95;  // 5% discount
+    ReportQuery query;
+    query.roomType = typeChoice - 2; // -1 = all
+    query.limit = REPORT_PAGE_SIZE;
+    while (true) {
+        int listed = 0;
+        int matched = 0;
+        {
+            shared_lock<shared_mutex> lock(hotel->reservationLock);
+            matched = writeReservationReport(cout, query, REPORT_TEXT, listed);
+            if (listed > 0) {
+                cout << "Showing " << query.offset + 1 << "-" << query.offset + listed
+                     << " of " << matched << " reservations\n";
             }
-
-            // Display reservation details
-            cout << "Room " << rooms[i].number << ":\n";
-            cout << "  Reservation ID: " << rooms[i].reservationId << "\n";
-            cout << "  Guest: " << rooms[i].guestName << "\n";
-            cout << "  Type: " << (rooms[i].isSingle ? "Single" : "Double") << "\n";
-            cout << "  Nights: " << rooms[i].nights << "\n";
-            cout << "  Breakfast: " << (rooms[i].includesBreakfast ? "Yes" : "No") << "\n";
-            cout << "  Total paid: " << fixed << setprecision(2) << finalPrice << " EUR\n";
-            cout << "  Discount applied: " << (rooms[i].discountRate * 100) << "%\n";
-            if (rooms[i].includesBreakfast) {
-                cout << "  + Additional 5% breakfast discount\n";
+            if (query.offset + listed >= matched) {
+                if (typeChoice == 1 && matched > 0) writeSummary(cout, 0);
+                return; // Last page shown
             }
-            cout << "------------------------------------\n";
         }
-    }
-    
-    if (!hasReservations) {
-        cout << "No reservations found.\n";
+        if (getValidatedInput("Show next page? (1=Yes, 2=No): ", 1, 2) != 1) {
+            return;
+        }
+        query.offset += listed;
     }
 }
 
@@ -375,28 +1422,24 @@ void searchReservation()
     
     if (searchType == 1) {
         // Search by reservation ID
-        int searchId = getValidatedInput("Enter reservation ID: ", 10000, 99999);
+        int searchId = getValidatedInput("Enter reservation ID: ", 10000, hotel->idAllocator.rangeHigh);
         
-        for (int i = 0; i < totalRooms; i++) 
-        {
-            if (rooms[i].isBooked && rooms[i].reservationId == searchId) {
-                found = true;
-                double finalPrice = calculateFinalPrice(i+1, rooms[i].nights, rooms[i].discountRate);
-                
-                // Apply breakfast discount
-                if (rooms[i].includesBreakfast) {
-                    finalPrice = finalPrice * 0.95;
-                }
-                
-                cout << "\nReservation found:\n";
-                cout << "Room: " << rooms[i].number << "\n";
-                cout << "Guest: " << rooms[i].guestName << "\n";
-                cout << "Type: " << (rooms[i].isSingle ? "Single" : "Double") << "\n";
-                cout << "Nights: " << rooms[i].nights << "\n";
-                cout << "Breakfast: " << (rooms[i].includesBreakfast ? "Yes" : "No") << "\n";
-                cout << "Total paid: " << fixed << setprecision(2) << finalPrice << " EUR\n";
-                break; // Stop searching after finding the reservation
-            }
+        OperationTimer timer(METRIC_SEARCH_RESERVATION);
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        int r = findReservationById(searchId);
+        if (r != -1) {
+            found = true;
+            int i = reservedRoomOf(r);
+            int64_t finalPrice = reservationTotal(r);
+            
+            cout << "\nReservation found:\n";
+            cout << "Room: " << roomNumberOf(i) << "\n";
+            cout << "Guest: " << guestNameOf(r) << "\n";
+            cout << "Type: " << ROOM_TYPES[roomTypeOf(i)].label << "\n";
+            cout << "Arrival: day " << arrivalDayOf(r) << "\n";
+            cout << "Nights: " << nightsOf(r) << "\n";
+            cout << "Breakfast: " << (includesBreakfast(r) ? "Yes" : "No") << "\n";
+            cout << "Total paid: " << formatCents(finalPrice) << " EUR\n";
         }
     } else {
         // Search by guest name
@@ -405,39 +1448,28 @@ void searchReservation()
         string searchName;
         getline(cin, searchName);
         
-        // Convert to lowercase for case-insensitive search
-        transform(searchName.begin(), searchName.end(), searchName.begin(), ::tolower);
-        
-        for (int i = 0; i < totalRooms; i++) {
-            if (rooms[i].isBooked) {
-                string roomGuestName = rooms[i].guestName;
-                transform(roomGuestName.begin(), roomGuestName.end(), roomGuestName.begin(), ::tolower);
-                
-                // Check if search term is contained in guest name
-                if (roomGuestName.find(searchName) != string::npos) {
-                    if (!found) {
-                        cout << "\nReservations found:\n";
-                        found = true;
-                    }
-                    
-                    double finalPrice = calculateFinalPrice(i+1, rooms[i].nights, rooms[i].discountRate);
-                    
-                    // Apply breakfast discount
-                    if (rooms[i].includesBreakfast) {
-                        finalPrice = finalPrice * 0.95;
-                    }
-                    
-                    // Display reservation details
-                    cout << "------------------------------------\n";
-                    cout << "Room: " << rooms[i].number << "\n";
-                    cout << "Reservation ID: " << rooms[i].reservationId << "\n";
-                    cout << "Guest: " << rooms[i].guestName << "\n";
-                    cout << "Type: " << (rooms[i].isSingle ? "Single" : "Double") << "\n";
-                    cout << "Nights: " << rooms[i].nights << "\n";
-                    cout << "Breakfast: " << (rooms[i].includesBreakfast ? "Yes" : "No") << "\n";
-                    cout << "Total paid: " << fixed << setprecision(2) << finalPrice << " EUR\n";
-                }
+        OperationTimer timer(METRIC_SEARCH_RESERVATION);
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        vector<int> matches = findReservationsByName(searchName);
+        for (int r : matches) {
+            if (!found) {
+                cout << "\nReservations found:\n";
+                found = true;
             }
+            
+            int i = reservedRoomOf(r);
+            int64_t finalPrice = reservationTotal(r);
+            
+            // Display reservation details
+            cout << "------------------------------------\n";
+            cout << "Room: " << roomNumberOf(i) << "\n";
+            cout << "Reservation ID: " << reservationIdOf(r) << "\n";
+            cout << "Guest: " << guestNameOf(r) << "\n";
+            cout << "Type: " << ROOM_TYPES[roomTypeOf(i)].label << "\n";
+            cout << "Arrival: day " << arrivalDayOf(r) << "\n";
+            cout << "Nights: " << nightsOf(r) << "\n";
+            cout << "Breakfast: " << (includesBreakfast(r) ? "Yes" : "No") << "\n";
+            cout << "Total paid: " << formatCents(finalPrice) << " EUR\n";
         }
     }
     
@@ -446,81 +1478,833 @@ void searchReservation()
     }
 }
 
-// Displays all currently available rooms
+// Cancels a reservation, or changes its number of nights or its room
 
-void displayAvailableRooms() {
-    cout << "\n======== AVAILABLE ROOMS ========\n";
-    
-    int availableSingles = 0; // Counter for available single rooms
-    int availableDoubles = 0; // Counter for available double rooms
+void changeReservation()
+{
+    cout << "\n======== CHANGE RESERVATION ========\n";
+    int reservationId = getValidatedInput("Enter reservation ID: ", 10000, hotel->idAllocator.rangeHigh);
     
-    // Display available single rooms
-    cout << "Single rooms available:\n";
-    for (int i = 0; i < totalRooms; i++) {
-        if (rooms[i].isSingle && !rooms[i].isBooked) {
-            // Format output: 10 rooms per line
-            if (availableSingles % 10 == 0 && availableSingles > 0) cout << "\n";
-            cout << setw(4) << rooms[i].number;
-            availableSingles++;
+    int maxNights;
+    int roomType;
+    {
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        int r = findReservationById(reservationId);
+        if (r == -1) {
+            cout << "No reservations found.\n";
+            return;
         }
+        int i = reservedRoomOf(r);
+        roomType = roomTypeOf(i);
+        cout << "\nRoom: " << roomNumberOf(i) << " (" << ROOM_TYPES[roomTypeOf(i)].label << ")\n";
+        cout << "Guest: " << guestNameOf(r) << "\n";
+        cout << "Arrival: day " << arrivalDayOf(r) << "\n";
+        cout << "Nights: " << nightsOf(r) << "\n";
+        cout << "Total price: " << formatCents(reservationTotal(r)) << " EUR\n";
+        maxNights = min(MAX_NIGHTS, CALENDAR_DAYS - arrivalDayOf(r));
     }
-    if (availableSingles == 0) cout << "None";
-    cout << "\n\n";
     
-    // Display available double rooms
-    cout << "Double rooms available:\n";
-    for (int i = 0; i < totalRooms; i++) {
-        if (!rooms[i].isSingle && !rooms[i].isBooked) {
-            // Format output: 10 rooms per line
-            if (availableDoubles % 10 == 0 && availableDoubles > 0) cout << "\n";
-            cout << setw(4) << rooms[i].number;
-            availableDoubles++;
-        }
-    }
-    if (availableDoubles == 0) cout << "None";
-    cout << "\n\n";
+    cout << "\n1. Cancel reservation\n";
+    cout << "2. Change number of nights\n";
+    cout << "3. Move to another room\n";
+    cout << "4. Keep reservation as it is\n";
+    int choice = getValidatedInput("Enter choice (1-4): ", 1, 4);
+    
+    bool changed = false;
+    if (choice == 1) {
+        cout << (cancelReservation(reservationId) ? "Reservation cancelled.\n"
+                                                  : "Reservation was already cancelled.\n");
+        return;
+    } else if (choice == 2) {
+        int nights = getValidatedInput("Enter new number of nights (1-" + to_string(maxNights) + "): ",
+                                       1, maxNights);
+        changed = modifyReservation(reservationId, -1, -1, nights);
+    } else if (choice == 3) {
+        cout << "1. Let system assign another available room\n";
+        cout << "2. Choose a specific room number\n";
+        int method = getValidatedInput("Enter choice (1-2): ", 1, 2);
+        // Rooms of a type are numbered consecutively; moves stay within the type
+        int firstRoom = hotel->firstRoomOfType[roomType] + 1;
+        int lastRoom = hotel->firstRoomOfType[roomType + 1];
+        int roomNumber = (method == 1) ? 0
+                         : getValidatedInput("Enter room number (" + to_string(firstRoom) + "-"
+                                             + to_string(lastRoom) + "): ", firstRoom, lastRoom);
+        changed = modifyReservation(reservationId, roomNumber, -1, -1);
+    } else {
+        return;
+    }
+    
+    if (!changed) {
+        cout << "Sorry, no room is free for those nights. The reservation was not changed.\n";
+        return;
+    }
+    shared_lock<shared_mutex> lock(hotel->reservationLock);
+    int r = findReservationById(reservationId);
+    if (r != -1) {
+        cout << "\nReservation changed!\n";
+        cout << "Room: " << roomNumberOf(reservedRoomOf(r)) << "\n";
+        cout << "Nights: " << nightsOf(r) << "\n";
+        cout << "Total price: " << formatCents(reservationTotal(r)) << " EUR\n";
+    }
+}
+
+// Displays all rooms that are free for a range of nights
+// @param out Stream receiving the listing
+// @param arrivalDay First night (0 = tonight)
+// @param nights Number of nights
+
+void displayAvailableRooms(ostream& out, int arrivalDay, int nights) {
+    OperationTimer timer(METRIC_DISPLAY_AVAILABLE_ROOMS);
+    string& buffer = reportBuffer;
+    buffer.clear();
+    buffer += "\n======== AVAILABLE ROOMS ========\n";
+    if (arrivalDay != 0 || nights != 1) {
+        buffer += "Nights: day ";
+        appendNumber(buffer, arrivalDay);
+        buffer += " to day ";
+        appendNumber(buffer, arrivalDay + nights - 1);
+        buffer += '\n';
+    }
+    
+    int availableCount[ROOM_TYPE_COUNT] = {0};
+    vector<uint64_t> mask; // Rooms of the current type free on every night
+    
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        int base = freeRoomsMask(t, arrivalDay, nights, mask);
+        availableCount[t] = countSetBits(mask);
+        
+        // Walk the free-room mask in room order
+        int listed = 0; // Rooms printed so far for this type
+        buffer += ROOM_TYPES[t].label;
+        buffer += " rooms available:\n";
+        for (int i = nextSetBit(mask, 0); i != -1; i = nextSetBit(mask, i + 1)) {
+            // Format output: 10 rooms per line
+            if (listed % 10 == 0 && listed > 0) buffer += '\n';
+            appendNumber(buffer, roomNumberOf(base + i), 4);
+            listed++;
+            if (buffer.size() >= REPORT_FLUSH_BYTES) flushReport(out, buffer);
+        }
+        if (listed == 0) buffer += "None";
+        buffer += "\n\n";
+    }
     
     // Display summary
-    cout << "Summary: " << availableSingles << " single rooms, " 
-         << availableDoubles << " double rooms available.\n";
+    buffer += "Summary: ";
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        if (t > 0) buffer += ", ";
+        appendNumber(buffer, availableCount[t]);
+        buffer += ' ';
+        buffer += ROOM_TYPES[t].name;
+        buffer += " rooms";
+    }
+    buffer += " available.\n";
+    flushReport(out, buffer);
 }
 
 /**
  * Calculates the final price for a reservation
  * @param roomNumber The room number
+ * @param arrivalDay First night (0 = tonight)
  * @param nights Number of nights
- * @param discount Discount rate (0.0 to 1.0)
- * @return Final price after discount
+ * @param discountPercent Discount given at booking (0-100 %)
+ * @param hasBreakfast True if breakfast was added
+ * @return Final price in cents, under the room type's pricing policy
+ */
+inline int64_t calculateFinalPrice(int roomNumber, int arrivalDay, int nights, int discountPercent,
+                                   bool hasBreakfast) {
+    return priceStay(roomTypeOf(roomNumber-1), roomBasePrice(roomNumber-1), arrivalDay, nights,
+                     discountPercent, hasBreakfast);
+}
+
+/**
+ * Prices a run of reservation slots in one pass (reports and listings)
+ * Uses the AVX2 kernel when the CPU supports it; both paths give the
+ * same cents as priceStay.
+ * @param firstSlot First slot to price
+ * @param count Number of consecutive slots
+ * @param totals Receives one total per slot, in cents (0 for free slots)
+ */
+void priceReservations(int firstSlot, int count, int64_t* totals)
+{
+#if defined(__x86_64__)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (hasAvx2) {
+        priceReservationsAvx2(firstSlot, count, totals);
+        return;
+    }
+#endif
+    priceReservationsScalar(firstSlot, count, totals);
+}
+
+/**
+ * Portable version of priceReservations
+ * @param firstSlot First slot to price
+ * @param count Number of consecutive slots
+ * @param totals Receives one total per slot, in cents (0 for free slots)
+ */
+void priceReservationsScalar(int firstSlot, int count, int64_t* totals)
+{
+    for (int k = 0; k < count; k++) {
+        int r = firstSlot + k;
+        totals[k] = isActiveReservation(r) ? reservationTotal(r) : 0;
+    }
+}
+
+#if defined(__x86_64__)
+/**
+ * Rounds four exact stay products half up to cents and stores them
+ * @param scaled base x night percent x discount factor x stay factor
+ * @param out Receives four totals, in cents
+ */
+__attribute__((target("avx2")))
+void storeCentsAvx2(__m256d scaled, int64_t* out)
+{
+    const __m256d magic = _mm256_set1_pd(4503599627370496.0); // 2^52: its low mantissa bits hold an integer
+    __m256d cents = _mm256_floor_pd(_mm256_div_pd(_mm256_add_pd(scaled, _mm256_set1_pd(50000000.0)),
+                                                  _mm256_set1_pd(100000000.0)));
+    __m256i bits = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(cents, magic)),
+                                    _mm256_castpd_si256(magic));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bits);
+}
+
+/**
+ * Looks up a per-type policy column for eight room types
+ * @param column Policy column (POLICY_COLUMN entries)
+ * @param type Room type of each lane
+ * @return Column entry of each lane
+ */
+__attribute__((target("avx2")))
+inline __m256i policyLookupAvx2(const int32_t* column, __m256i type)
+{
+    if (ROOM_TYPE_COUNT <= 8) {
+        // The whole column fits in one register
+        return _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(column)), type);
+    }
+    return _mm256_i32gather_epi32(column, type, 4);
+}
+
+/**
+ * AVX2 version of priceReservations: eight slots per step
+ * The byte columns are widened to 32-bit lanes, the base prices gathered,
+ * the room type found from the type boundaries and its policy looked up
+ * in registers; peak nights are the overlap of the stay with each season.
+ * The small products (nights and percentages, all below 2^15) are
+ * 16-bit multiply-adds, half the micro-ops of a 32-bit multiply.
+ * The product is formed in doubles, where it is exact (see
+ * MAX_BASE_PRICE_CENTS); dividing and flooring is then exact as well.
+ * @param firstSlot First slot to price
+ * @param count Number of consecutive slots
+ * @param totals Receives one total per slot, in cents (0 for free slots)
+ */
+__attribute__((target("avx2")))
+void priceReservationsAvx2(int firstSlot, int count, int64_t* totals)
+{
+    const ReservationStore& store = hotel->reservationStore;
+    const int* basePrices = hotel->roomStore.basePriceCents.data();
+    const __m256i one = _mm256_set1_epi32(RES_ACTIVE);
+    const __m256i two = _mm256_set1_epi32(RES_BREAKFAST);
+    const __m256i hundred = _mm256_set1_epi32(100);
+    __m256i lastRoomBefore[ROOM_TYPE_COUNT]; // Room index before each type's first room
+    for (int t = 1; t < ROOM_TYPE_COUNT; t++) {
+        lastRoomBefore[t] = _mm256_set1_epi32(hotel->firstRoomOfType[t] - 1);
+    }
+    
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        int r = firstSlot + k;
+        __m256i status = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&store.status[r])));
+        __m256i nights = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&store.nights[r])));
+        __m256i discount = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&store.discountPercent[r])));
+        __m256i arrival = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&store.arrivalDay[r])));
+        __m256i rooms = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&store.roomIndex[r]));
+        
+        // Free slots gather nothing and so cost 0
+        __m256i active = _mm256_cmpeq_epi32(_mm256_and_si256(status, one), one);
+        __m256i base = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), basePrices, rooms, active, 4);
+        
+        // Rooms are numbered by type: count the type boundaries below each room
+        __m256i type = _mm256_setzero_si256();
+        for (int t = 1; t < ROOM_TYPE_COUNT; t++) {
+            type = _mm256_sub_epi32(type, _mm256_cmpgt_epi32(rooms, lastRoomBefore[t]));
+        }
+        type = _mm256_and_si256(type, active);
+        
+        // Peak nights: overlap of [arrival, departure) with each season
+        __m256i departure = _mm256_add_epi32(arrival, nights);
+        __m256i peakNights = _mm256_setzero_si256();
+        for (const PeakSeason& season : PEAK_SEASONS) {
+            __m256i overlap = _mm256_sub_epi32(_mm256_min_epi32(departure, _mm256_set1_epi32(season.lastDay + 1)),
+                                               _mm256_max_epi32(arrival, _mm256_set1_epi32(season.firstDay)));
+            peakNights = _mm256_add_epi32(peakNights, _mm256_max_epi32(overlap, _mm256_setzero_si256()));
+        }
+        __m256i nightPercent = _mm256_madd_epi16(_mm256_or_si256(nights, _mm256_slli_epi32(peakNights, 16)),
+                                                 policyLookupAvx2(PRICING.nightWeights, type));
+        
+        // Booking discount, long stay and breakfast, each off what is left
+        __m256i longStay = _mm256_cmpgt_epi32(nights, policyLookupAvx2(PRICING.shortStayNights, type));
+        __m256i longStayPercent = _mm256_and_si256(longStay, policyLookupAvx2(PRICING.longStayDiscount, type));
+        __m256i breakfast = _mm256_cmpeq_epi32(_mm256_and_si256(status, two), two);
+        __m256i breakfastPercent = _mm256_and_si256(breakfast, policyLookupAvx2(PRICING.breakfastDiscount, type));
+        __m256i factor = _mm256_madd_epi16(_mm256_sub_epi32(hundred, discount),
+                                           _mm256_madd_epi16(_mm256_sub_epi32(hundred, longStayPercent),
+                                                             _mm256_sub_epi32(hundred, breakfastPercent)));
+        
+        storeCentsAvx2(_mm256_mul_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(base)),
+                                                   _mm256_cvtepi32_pd(_mm256_castsi256_si128(nightPercent))),
+                                     _mm256_cvtepi32_pd(_mm256_castsi256_si128(factor))), totals + k);
+        storeCentsAvx2(_mm256_mul_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(base, 1)),
+                                                   _mm256_cvtepi32_pd(_mm256_extracti128_si256(nightPercent, 1))),
+                                     _mm256_cvtepi32_pd(_mm256_extracti128_si256(factor, 1))), totals + k + 4);
+    }
+    priceReservationsScalar(firstSlot + k, count - k, totals + k);
+}
+#endif
+
+/**
+ * End-of-day revenue: prices every active reservation with the batch kernel
+ * The caller holds reservationLock, shared or not.
+ * @param reservations Receives the number of active reservations
+ * @return Sum of all reservation totals, in cents
+ */
+int64_t totalRevenue(int& reservations)
+{
+    int64_t totals[PRICE_BATCH];
+    int64_t revenue = 0;
+    reservations = 0;
+    for (int first = 0; first < reservationSlotCount(); first += PRICE_BATCH) {
+        int count = min(PRICE_BATCH, reservationSlotCount() - first);
+        priceReservations(first, count, totals);
+        for (int k = 0; k < count; k++) {
+            revenue += totals[k];
+            reservations += isActiveReservation(first + k);
+        }
+    }
+    return revenue;
+}
+
+/**
+ * Formats an amount of cents as EUR with two decimals ("1234.50")
+ * @param cents Amount in cents
+ * @return Formatted amount
+ */
+string formatCents(int64_t cents)
+{
+    string text;
+    appendCents(text, cents);
+    return text;
+}
+
+/**
+ * Writes a reservation listing in one pass through the report buffer
+ * Matches are filtered and paged first, and only the listed ones are
+ * priced (with the batch kernel when they are many). The caller holds
+ * reservationLock, shared or not.
+ * @param out Stream receiving the report
+ * @param query Filters and page
+ * @param format ReportFormat
+ * @param listed Receives the number of reservations written
+ * @return Number of reservations matching the filters (all pages)
+ */
+int writeReservationReport(ostream& out, const ReportQuery& query, int format, int& listed)
+{
+    OperationTimer timer(METRIC_VIEW_RESERVATIONS);
+    
+    // Collect the matching reservations
+    vector<int> slots;
+    for (int r = 0; r < reservationSlotCount(); r++) {
+        if (isActiveReservation(r) &&
+            (query.roomType == -1 || roomTypeOf(reservedRoomOf(r)) == query.roomType) &&
+            (query.breakfast == -1 || includesBreakfast(r) == (query.breakfast == 1)) &&
+            (query.discountPercent == -1 || discountOf(r) == query.discountPercent)) {
+            slots.push_back(r);
+        }
+    }
+    int matched = static_cast<int>(slots.size());
+    int first = min(query.offset, matched);
+    int last = (query.limit < 0) ? matched : min(matched, first + query.limit);
+    listed = last - first;
+    slots = sortedByRoom(move(slots), first, last);
+    
+    // Price only the listed reservations. The kernel works on consecutive
+    // slots, so it pays off only when the listing covers a good share of
+    // them; a page is priced one reservation at a time.
+    vector<int64_t> totals(listed);
+    if (listed < reservationSlotCount() / PRICE_KERNEL_SHARE) {
+        for (int k = 0; k < listed; k++) {
+            totals[k] = reservationTotal(slots[first + k]);
+        }
+    } else {
+        vector<int64_t> slotTotals(reservationSlotCount()); // Free slots come out as 0
+        for (int slot = 0; slot < reservationSlotCount(); slot += PRICE_BATCH) {
+            priceReservations(slot, min(PRICE_BATCH, reservationSlotCount() - slot), &slotTotals[slot]);
+        }
+        for (int k = 0; k < listed; k++) {
+            totals[k] = slotTotals[slots[first + k]];
+        }
+    }
+    
+    string& buffer = reportBuffer;
+    buffer.clear();
+    if (format == REPORT_CSV) {
+        buffer += "reservation_id,room,type,guest,arrival_day,nights,breakfast,discount_percent,total_eur\n";
+    } else if (format == REPORT_JSON) {
+        buffer += "[\n";
+    }
+    for (int k = first; k < last; k++) {
+        appendReservation(buffer, slots[k], totals[k - first], format, k == first);
+        if (buffer.size() >= REPORT_FLUSH_BYTES) {
+            flushReport(out, buffer);
+        }
+    }
+    if (format == REPORT_JSON) {
+        buffer += (listed > 0) ? "\n]\n" : "]\n";
+    } else if (format == REPORT_TEXT && matched == 0) {
+        buffer += "No reservations found.\n";
+    }
+    flushReport(out, buffer);
+    return matched;
+}
+
+/**
+ * Formats one reservation into the report buffer
+ * @param buffer Report buffer
+ * @param slot Active reservation
+ * @param total Its price in cents
+ * @param format ReportFormat
+ * @param first True for the first record of the report (JSON separators)
+ */
+void appendReservation(string& buffer, int slot, int64_t total, int format, bool first)
+{
+    int i = reservedRoomOf(slot);
+    const RoomTypeInfo& type = ROOM_TYPES[roomTypeOf(i)];
+    
+    if (format == REPORT_CSV) {
+        appendNumber(buffer, reservationIdOf(slot));
+        buffer += ',';
+        appendNumber(buffer, roomNumberOf(i));
+        buffer += ',';
+        buffer += type.name;
+        buffer += ',';
+        appendQuoted(buffer, guestNameOf(slot), REPORT_CSV);
+        buffer += ',';
+        appendNumber(buffer, arrivalDayOf(slot));
+        buffer += ',';
+        appendNumber(buffer, nightsOf(slot));
+        buffer += includesBreakfast(slot) ? ",yes," : ",no,";
+        appendNumber(buffer, discountOf(slot));
+        buffer += ',';
+        appendCents(buffer, total);
+        buffer += '\n';
+    } else if (format == REPORT_JSON) {
+        buffer += first ? "  {\"reservation_id\": " : ",\n  {\"reservation_id\": ";
+        appendNumber(buffer, reservationIdOf(slot));
+        buffer += ", \"room\": ";
+        appendNumber(buffer, roomNumberOf(i));
+        buffer += ", \"type\": \"";
+        buffer += type.name;
+        buffer += "\", \"guest\": ";
+        appendQuoted(buffer, guestNameOf(slot), REPORT_JSON);
+        buffer += ", \"arrival_day\": ";
+        appendNumber(buffer, arrivalDayOf(slot));
+        buffer += ", \"nights\": ";
+        appendNumber(buffer, nightsOf(slot));
+        buffer += includesBreakfast(slot) ? ", \"breakfast\": true, \"discount_percent\": "
+                                          : ", \"breakfast\": false, \"discount_percent\": ";
+        appendNumber(buffer, discountOf(slot));
+        buffer += ", \"total_eur\": ";
+        appendCents(buffer, total);
+        buffer += '}';
+    } else {
+        buffer += "Room ";
+        appendNumber(buffer, roomNumberOf(i));
+        buffer += ":\n  Reservation ID: ";
+        appendNumber(buffer, reservationIdOf(slot));
+        buffer += "\n  Guest: ";
+        buffer += guestNameOf(slot);
+        buffer += "\n  Type: ";
+        buffer += type.label;
+        buffer += "\n  Arrival: day ";
+        appendNumber(buffer, arrivalDayOf(slot));
+        buffer += "\n  Nights: ";
+        appendNumber(buffer, nightsOf(slot));
+        buffer += includesBreakfast(slot) ? "\n  Breakfast: Yes\n  Total paid: " : "\n  Breakfast: No\n  Total paid: ";
+        appendCents(buffer, total);
+        buffer += " EUR\n  Discount applied: ";
+        appendNumber(buffer, discountOf(slot));
+        buffer += "%\n";
+        if (nightsOf(slot) >= type.pricing.longStayNights) {
+            buffer += "  + Additional ";
+            appendNumber(buffer, type.pricing.longStayDiscountPercent);
+            buffer += "% long-stay discount\n";
+        }
+        if (includesBreakfast(slot)) {
+            buffer += "  + Additional ";
+            appendNumber(buffer, type.pricing.breakfastDiscountPercent);
+            buffer += "% breakfast discount\n";
+        }
+        buffer += "------------------------------------\n";
+    }
+}
+
+/**
+ * Reads report options: type=<room type name>, breakfast=yes|no,
+ * discount=N, offset=N, limit=N (each may also be "any"/omitted)
+ * @param args Remaining command arguments
+ * @param query Receives the options
+ * @return False if an option is unknown or malformed
+ */
+bool parseReportQuery(istream& args, ReportQuery& query)
+{
+    string option;
+    while (args >> option) {
+        size_t equals = option.find('=');
+        if (equals == string::npos) {
+            return false;
+        }
+        string key = option.substr(0, equals);
+        string value = option.substr(equals + 1);
+        char* end = nullptr;
+        long number = strtol(value.c_str(), &end, 10);
+        bool isNumber = !value.empty() && *end == '\0' && number >= 0 && number <= INT32_MAX;
+        
+        if (key == "type" && (value == "any" || roomTypeNamed(value) != -1)) {
+            query.roomType = roomTypeNamed(value); // -1 for "any"
+        } else if (key == "breakfast" && (value == "yes" || value == "no" || value == "any")) {
+            query.breakfast = (value == "yes") ? 1 : (value == "no") ? 0 : -1;
+        } else if (key == "discount" && (value == "any" || (isNumber && number <= 100))) {
+            query.discountPercent = (value == "any") ? -1 : static_cast<int>(number);
+        } else if (key == "offset" && isNumber) {
+            query.offset = static_cast<int>(number);
+        } else if (key == "limit" && isNumber) {
+            query.limit = static_cast<int>(number);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Appends a decimal integer, right-aligned in a field
+ * @param buffer Report buffer
+ * @param value Number to write
+ * @param width Minimum field width (padded with spaces on the left)
+ */
+void appendNumber(string& buffer, int64_t value, int width)
+{
+    char digits[24];
+    int length = 0;
+    uint64_t magnitude = (value < 0) ? 0 - uint64_t(value) : uint64_t(value);
+    do {
+        digits[length++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        digits[length++] = '-';
+    }
+    if (width > length) {
+        buffer.append(width - length, ' ');
+    }
+    while (length > 0) {
+        buffer += digits[--length];
+    }
+}
+
+/**
+ * Appends an amount of cents as EUR with two decimals ("1234.50")
+ * @param buffer Report buffer
+ * @param cents Amount in cents
+ */
+void appendCents(string& buffer, int64_t cents)
+{
+    if (cents < 0) {
+        buffer += '-';
+        cents = -cents;
+    }
+    appendNumber(buffer, cents / 100);
+    buffer += '.';
+    buffer += static_cast<char>('0' + cents % 100 / 10);
+    buffer += static_cast<char>('0' + cents % 10);
+}
+
+/**
+ * Appends a text field quoted for CSV ("" escapes a quote) or as a JSON string
+ * @param buffer Report buffer
+ * @param text Field value
+ * @param format REPORT_CSV or REPORT_JSON
+ */
+void appendQuoted(string& buffer, string_view text, int format)
+{
+    buffer += '"';
+    for (char c : text) {
+        if (c == '"') {
+            buffer += (format == REPORT_CSV) ? "\"\"" : "\\\"";
+        } else if (format == REPORT_JSON && c == '\\') {
+            buffer += "\\\\";
+        } else if (format == REPORT_JSON && static_cast<unsigned char>(c) < 0x20) {
+            const char* hex = "0123456789abcdef";
+            buffer += "\\u00";
+            buffer += hex[(c >> 4) & 0xf];
+            buffer += hex[c & 0xf];
+        } else {
+            buffer += c;
+        }
+    }
+    buffer += '"';
+}
+
+/**
+ * Writes the buffered report text and empties the buffer
+ * @param out Destination stream
+ * @param buffer Report buffer
  */
-double calculateFinalPrice(int roomNumber, int nights, double discount) {
-    double basePrice = rooms[roomNumber-1].basePrice;
-    double total = basePrice * nights;
-    return total * (1.0 - discount); // Apply discount
+void flushReport(ostream& out, string& buffer)
+{
+    out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    buffer.clear();
 }
 
 /**
  * Generates a unique reservation ID
- * @return Random reservation ID between 10000 and 99999
+ * @return Random reservation ID, not held by any live reservation
+ *         (10000-99999 until that range is used up)
  */
 int generateReservationId() 
 {
-    return 10000 + rand() % 90000; // Generates number in range 10000-99999
+    lock_guard<mutex> lock(hotel->idLock);
+    return drawReservationId();
+}
+
+/**
+ * Generates several unique reservation IDs, holding idLock once
+ * @param count Number of IDs
+ * @param reservationIds Receives the IDs
+ */
+void generateReservationIds(int count, int* reservationIds)
+{
+    lock_guard<mutex> lock(hotel->idLock);
+    for (int k = 0; k < count; k++) {
+        reservationIds[k] = drawReservationId();
+    }
+}
+
+/**
+ * Draws the next reservation ID (the caller holds idLock)
+ * @return Random reservation ID, not held by any live reservation
+ */
+int drawReservationId()
+{
+    IdAllocator& ids = hotel->idAllocator;
+    
+    if (ids.drawn == ids.rangeHigh - ids.rangeLow + 1) {
+        // Current range used up: reuse a cancelled ID if there is one
+        if (!ids.freedIds.empty()) {
+            int reservationId = ids.freedIds.back();
+            ids.freedIds.pop_back();
+            return reservationId;
+        }
+        
+        // Otherwise open the next range, one digit wider
+        openNextIdRange();
+    }
+    
+    // Fisher-Yates step: take a random undrawn position
+    int rangeSize = ids.rangeHigh - ids.rangeLow + 1;
+    return ids.rangeLow + takeIdPosition(ids.drawn + randomBelow(rangeSize - ids.drawn));
+}
+
+/**
+ * Moves the allocator to the next ID range, one digit wider
+ */
+void openNextIdRange()
+{
+    IdAllocator& ids = hotel->idAllocator;
+    ids.rangeLow = ids.rangeHigh + 1;
+    ids.rangeHigh = (ids.rangeLow > numeric_limits<int>::max() / 10)
+                    ? numeric_limits<int>::max() : ids.rangeLow * 10 - 1;
+    ids.drawn = 0;
+    ids.valueAt.clear();
+    ids.positionOf.clear();
+}
+
+/**
+ * Swaps an undrawn shuffle position into the drawn part of the range
+ * @param pos Shuffle position, at least idAllocator.drawn
+ * @return Offset (ID - rangeLow) that was stored at pos
+ */
+int takeIdPosition(int pos)
+{
+    IdAllocator& ids = hotel->idAllocator;
+    
+    // Only positions that differ from identity are stored
+    auto lookup = [](const unordered_map<int, int>& map, int key) {
+        auto it = map.find(key);
+        return (it != map.end()) ? it->second : key;
+    };
+    auto store = [](unordered_map<int, int>& map, int key, int value) {
+        if (key == value) map.erase(key); else map[key] = value;
+    };
+    
+    int value = lookup(ids.valueAt, pos);
+    int other = lookup(ids.valueAt, ids.drawn);
+    
+    // 'other' moves to pos; 'value' moves to the drawn slot, whose
+    // position is never looked up again
+    store(ids.valueAt, pos, other);
+    store(ids.positionOf, other, pos);
+    ids.valueAt.erase(ids.drawn);
+    store(ids.positionOf, value, ids.drawn);
+    ids.drawn++;
+    return value;
+}
+
+/**
+ * Marks a specific ID of the current range as drawn (used by recovery,
+ * before any other thread runs)
+ * @param reservationId ID that is already in use
+ * @return False if the ID is outside the current range or already drawn
+ */
+bool claimReservationId(int reservationId)
+{
+    IdAllocator& ids = hotel->idAllocator;
+    if (reservationId < ids.rangeLow || reservationId > ids.rangeHigh) {
+        return false;
+    }
+    
+    int offset = reservationId - ids.rangeLow;
+    auto it = ids.positionOf.find(offset);
+    int pos = (it != ids.positionOf.end()) ? it->second : offset;
+    if (pos < ids.drawn) {
+        return false;
+    }
+    takeIdPosition(pos);
+    return true;
 }
 
 /**
- * Generates a random discount rate
- * @return Discount rate: 0.00 (0%), 0.10 (10%), or 0.20 (20%)
+ * Resets the allocator so that it never hands out a live reservation ID
+ * Opens the range holding the largest live ID and claims every live ID
+ * in it. Older ranges were used up before, so they are only reused
+ * through IDs cancelled from now on.
  */
-double getRandomDiscount() 
+void rebuildIdAllocator()
 {
-    int discountType = rand() % 3; // Random number: 0, 1, or 2
+    hotel->idAllocator = IdAllocator();
     
-    switch (discountType) {
-        case 0: return 0.00;   // 0% discount
-        case 1: return 0.10;   // 10% discount
-        case 2: return 0.20;   // 20% discount
-        default: return 0.00;  // Fallback
+    int maxId = 0;
+    for (const auto& entry : hotel->reservationIndex) {
+        maxId = max(maxId, entry.first);
+    }
+    while (maxId > hotel->idAllocator.rangeHigh) {
+        openNextIdRange();
+    }
+    for (const auto& entry : hotel->reservationIndex) {
+        claimReservationId(entry.first);
+    }
+}
+
+/**
+ * Returns a reservation ID to the allocator once it is no longer in use
+ * @param reservationId ID of a cancelled (or never confirmed) reservation
+ */
+void releaseReservationId(int reservationId)
+{
+    lock_guard<mutex> lock(hotel->idLock);
+    hotel->idAllocator.freedIds.push_back(reservationId);
+}
+
+/**
+ * Picks a room type at random, weighted by the types' room shares
+ * @return Index into ROOM_TYPES
+ */
+int randomRoomType()
+{
+    int draw = randomBelow(100);
+    int t = 0;
+    while (t + 1 < ROOM_TYPE_COUNT && draw >= ROOM_TYPES[t].sharePercent) {
+        draw -= ROOM_TYPES[t].sharePercent;
+        t++;
+    }
+    return t;
+}
+
+/**
+ * Looks up a room type by its command name
+ * @param name Name such as "single" or "suite"
+ * @return Index into ROOM_TYPES, or -1 if there is no such type
+ */
+int roomTypeNamed(const string& name)
+{
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        if (name == ROOM_TYPES[t].name) {
+            return t;
+        }
     }
+    return -1;
+}
+
+/**
+ * Asks the user for a room type
+ * @return Index into ROOM_TYPES
+ */
+int chooseRoomType()
+{
+    cout << "Select room type:\n";
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        const RoomTypeInfo& info = ROOM_TYPES[t];
+        cout << t + 1 << ". " << info.label << " room (" << info.guests
+             << (info.guests == 1 ? " person)\n" : " persons)\n");
+    }
+    return getValidatedInput("Enter choice (1-" + to_string(ROOM_TYPE_COUNT) + "): ", 1, ROOM_TYPE_COUNT) - 1;
+}
+
+/**
+ * Restarts random number generation from a seed
+ * Call before starting worker threads; the calling thread is reseeded
+ * and every other thread seeds its engine on its first draw.
+ * @param seed Program seed
+ */
+void seedRandom(unsigned int seed)
+{
+    randomSeed = seed;
+    randomStreams = 0;
+    randomEngineSeeded = false;
+}
+
+/**
+ * Draws a random number from the calling thread's engine
+ * @param bound Upper limit (exclusive, at least 1)
+ * @return Number in 0..bound-1
+ */
+int randomBelow(int bound)
+{
+    if (!randomEngineSeeded) {
+        seedThreadRandom(randomStreams.fetch_add(1));
+    }
+    return uniform_int_distribution<int>(0, bound - 1)(randomEngine);
+}
+
+/**
+ * Seeds the calling thread's engine with a fixed stream of the program seed
+ * @param stream Stream number, distinct per thread
+ */
+void seedThreadRandom(unsigned int stream)
+{
+    seed_seq seeds{randomSeed, stream};
+    randomEngine.seed(seeds);
+    randomEngineSeeded = true;
+}
+
+/**
+ * Draws a random fraction from the calling thread's engine
+ * @return Number in [0, 1)
+ */
+double randomFraction()
+{
+    if (!randomEngineSeeded) {
+        seedThreadRandom(randomStreams.fetch_add(1));
+    }
+    return uniform_real_distribution<double>(0.0, 1.0)(randomEngine);
 }
 
 /**
@@ -562,25 +2346,3685 @@ int getValidatedInput(const string& prompt, int min, int max) {
  * @return True if booking successful, false otherwise
  */
 bool bookRoom(int roomNumber, const string& guestName, int nights) {
+    OperationTimer timer(METRIC_BOOK_ROOM);
+    
     // Validate room number
-    if (roomNumber < 1 || roomNumber > totalRooms) {
+    if (roomNumber < 1 || roomNumber > hotel->totalRooms) {
         cout << "Invalid room number!\n";
         return false;
     }
     
-    // Check if room is already booked
-    if (rooms[roomNumber-1].isBooked) {
+    // Check if room is already booked (stay starts tonight)
+    if (!isValidStay(0, nights) || !isRoomFreeFor(roomNumber-1, 0, nights)) {
         cout << "Room is already booked!\n";
         return false;
     }
     
-    // Update room information
-    rooms[roomNumber-1].isBooked = true;
-    rooms[roomNumber-1].guestName = guestName;
-    rooms[roomNumber-1].nights = nights;
-    rooms[roomNumber-1].reservationId = generateReservationId();
-    rooms[roomNumber-1].discountRate = getRandomDiscount();
-    rooms[roomNumber-1].includesBreakfast = false; // Default no breakfast
+    // Update room information (default no breakfast)
+    int reservationId = generateReservationId();
+    if (commitReservation(roomNumber, reservationId, guestName, 0, nights,
+                          quoteDiscount(roomTypeOf(roomNumber-1), 0, nights), false) == -1) {
+        releaseReservationId(reservationId);
+        cout << "Room is already booked!\n"; // Taken by another booking meanwhile
+        return false;
+    }
     
     return true; // Booking successful
-}
\ No newline at end of file
+}
+
+/**
+ * Picks a random room of the requested type that is free for a stay
+ * A few random rooms of the type are tried first (each a hit with the
+ * chance of a room being free, and uniform over the free rooms); only
+ * a nearly full type falls back to scanning its free-room mask.
+ * @param roomType Index into ROOM_TYPES
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return Room number, or -1 if no room of that type is free
+ */
+int assignRandomRoom(int roomType, int arrivalDay, int nights)
+{
+    int count = roomCountOfType(roomType);
+    if (count == 0) {
+        return -1;
+    }
+    for (int probe = 0; probe < ASSIGN_ROOM_PROBES; probe++) {
+        int i = hotel->firstRoomOfType[roomType] + randomBelow(count);
+        if (isRoomFreeFor(i, arrivalDay, nights)) {
+            return roomNumberOf(i);
+        }
+    }
+    
+    thread_local vector<uint64_t> mask; // Reused between calls
+    int base = freeRoomsMask(roomType, arrivalDay, nights, mask);
+    int available = countSetBits(mask);
+    if (available == 0) {
+        return -1;
+    }
+    
+    return roomNumberOf(base + selectSetBit(mask, randomBelow(available)));
+}
+
+/**
+ * Takes the nights of a stay for one room if they are all still free
+ * The room's claim word is taken with a CAS first, so only one thread
+ * at a time tests and takes that room's nights; other rooms (even in
+ * the same calendar word) are not held up.
+ * @param roomIndex Index into rooms
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return True if the nights were free and are now taken
+ */
+bool claimRoomNights(int roomIndex, int arrivalDay, int nights)
+{
+    acquireRoomClaim(roomIndex);
+    bool free = isRoomFreeFor(roomIndex, arrivalDay, nights);
+    if (free) {
+        setRoomNights(roomIndex, arrivalDay, nights, false);
+    }
+    releaseRoomClaim(roomIndex);
+    return free;
+}
+
+/**
+ * Takes a room's claim word, waiting while another thread holds it
+ * @param roomIndex Index into rooms
+ */
+void acquireRoomClaim(int roomIndex)
+{
+    uint32_t* claim = &hotel->roomStore.claim[roomIndex];
+    uint32_t idle = 0;
+    while (!__atomic_compare_exchange_n(claim, &idle, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        idle = 0;
+        this_thread::yield(); // Held for a few loads and stores only
+    }
+}
+
+// Releases a claim word taken with acquireRoomClaim
+void releaseRoomClaim(int roomIndex)
+{
+    __atomic_store_n(&hotel->roomStore.claim[roomIndex], 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Takes the nights of a stay and stores the confirmed reservation
+ * @param roomNumber Room being booked
+ * @param reservationId ID handed to the guest
+ * @param guestName Name of guest
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param discountPercent Discount (0-100 %)
+ * @param hasBreakfast True if breakfast was added
+ * @return Slot of the new reservation in reservations, or -1 if another
+ *         booking holds one of the nights
+ */
+int commitReservation(int roomNumber, int reservationId, const string& guestName,
+                      int arrivalDay, int nights, int discountPercent, bool hasBreakfast)
+{
+    if (!claimRoomNights(roomNumber - 1, arrivalDay, nights)) {
+        return -1;
+    }
+    
+    unique_lock<shared_mutex> lock(hotel->reservationLock);
+    return storeReservation(roomNumber - 1, reservationId, guestName, arrivalDay, nights,
+                            discountPercent, hasBreakfast);
+}
+
+/**
+ * Stores a confirmed reservation whose nights are already claimed
+ * The caller holds reservationLock exclusively.
+ * @param roomIndex Index into rooms
+ * @param reservationId ID handed to the guest
+ * @param guestName Name of guest
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param discountPercent Discount (0-100 %)
+ * @param hasBreakfast True if breakfast was added
+ * @return Slot of the new reservation in reservations
+ */
+int storeReservation(int roomIndex, int reservationId, string_view guestName,
+                     int arrivalDay, int nights, int discountPercent, bool hasBreakfast)
+{
+    int slot = allocateReservationSlot();
+    ReservationStore& store = hotel->reservationStore;
+    store.reservationId[slot] = reservationId;
+    store.roomIndex[slot] = roomIndex;
+    store.arrivalDay[slot] = static_cast<int16_t>(arrivalDay);
+    store.nights[slot] = static_cast<uint8_t>(nights);
+    setGuestName(slot, guestName);
+    store.discountPercent[slot] = static_cast<uint8_t>(discountPercent);
+    store.status[slot] = RES_ACTIVE | (hasBreakfast ? RES_BREAKFAST : 0); // Save breakfast choice
+    
+    hotel->reservationIndex[reservationId] = slot;
+    indexGuestName(slot);
+    addToTotals(slot, +1);
+    
+    if (hotel->journal.fd != -1 && !hotel->journal.replaying) {
+        string payload;
+        encodeBook(payload, hotel->journal.nextLsn, slot);
+        logJournalRecord(payload);
+    }
+    return slot;
+}
+
+/**
+ * Books a room without any prompts (used by batch mode)
+ * @param roomType Index into ROOM_TYPES
+ * @param roomNumber Room to book, or 0 to let the system assign one
+ * @param guestName Name of guest
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param hasBreakfast True to add breakfast (the room type's breakfast discount)
+ * @return Reservation ID if successful, -1 if failed
+ */
+int reserveRoom(int roomType, int roomNumber, const string& guestName,
+                int arrivalDay, int nights, bool hasBreakfast)
+{
+    OperationTimer timer(METRIC_RESERVE_ROOM);
+    if (!isValidStay(arrivalDay, nights) || roomNumber < 0 || roomNumber > hotel->totalRooms) {
+        return -1;
+    }
+    
+    bool anyRoom = (roomNumber == 0);
+    while (true) {
+        if (anyRoom) {
+            roomNumber = assignRandomRoom(roomType, arrivalDay, nights);
+            if (roomNumber == -1) {
+                return -1; // No room of this type left for those nights
+            }
+        } else if (roomTypeOf(roomNumber-1) != roomType ||
+                   !isRoomFreeFor(roomNumber-1, arrivalDay, nights)) {
+            return -1; // Same rules as the interactive flow
+        }
+        
+        int reservationId = generateReservationId();
+        if (commitReservation(roomNumber, reservationId, guestName, arrivalDay, nights,
+                              quoteDiscount(roomType, arrivalDay, nights), hasBreakfast) != -1) {
+            return reservationId;
+        }
+        releaseReservationId(reservationId);
+        
+        if (!anyRoom) {
+            return -1;
+        }
+        // Another thread took the room first: pick again
+    }
+}
+
+/**
+ * Finds the best run of adjacent rooms of one type that are all free for
+ * a stay: the shortest free run that is long enough (so longer runs stay
+ * whole for later groups), the lowest such run on a tie
+ * Works a calendar word (64 rooms) at a time over the type's rooms only,
+ * and stops reading a word's nights as soon as none of its rooms is left.
+ * @param roomType Index into ROOM_TYPES
+ * @param roomCount Rooms wanted side by side
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return Room index of the first room of the block, or -1 if there is none
+ */
+int findRoomBlock(int roomType, int roomCount, int arrivalDay, int nights)
+{
+    int begin = hotel->firstRoomOfType[roomType];
+    int end = hotel->firstRoomOfType[roomType + 1];
+    if (roomCount < 1 || roomCount > end - begin) {
+        return -1;
+    }
+    
+    const uint64_t* firstRow = &hotel->calendar.freeBits[size_t(arrivalDay) * hotel->calendar.wordsPerDay];
+    int best = -1;
+    int bestLength = numeric_limits<int>::max();
+    int runStart = -1; // First room of the free run being scanned (-1 = none)
+    auto endRun = [&](int runEnd) {
+        int length = runEnd - runStart;
+        if (length >= roomCount && length < bestLength) {
+            best = runStart;
+            bestLength = length;
+        }
+        runStart = -1;
+    };
+    
+    for (int w = begin / 64; w <= (end - 1) / 64 && bestLength != roomCount; w++) {
+        // Rooms of the type in this word that are free on every night
+        uint64_t free = ~uint64_t(0);
+        if (w == begin / 64) free &= ~uint64_t(0) << (begin % 64);
+        if (w == (end - 1) / 64 && end % 64 != 0) free &= ~(~uint64_t(0) << (end % 64));
+        const uint64_t* row = firstRow + w;
+        for (int d = 0; d < nights && free != 0; d++, row += hotel->calendar.wordsPerDay) {
+            free &= __atomic_load_n(row, __ATOMIC_RELAXED);
+        }
+        
+        // Walk the runs of set bits: a run either ends in this word or
+        // carries on into the next one
+        int bit = 0;
+        while (bit < 64) {
+            if (runStart == -1) {
+                uint64_t rest = free >> bit;
+                if (rest == 0) break;
+                bit += __builtin_ctzll(rest);
+                runStart = w * 64 + bit;
+            }
+            uint64_t taken = ~free >> bit;
+            if (taken == 0) break; // Run reaches the end of the word
+            bit += __builtin_ctzll(taken);
+            endRun(w * 64 + bit);
+        }
+    }
+    if (runStart != -1 && bestLength != roomCount) {
+        endRun(end); // Run reaching the last room of the type
+    }
+    return best;
+}
+
+/**
+ * Books a block of adjacent rooms of one type for a group, all or nothing
+ * Every room becomes a reservation of its own under the group's name,
+ * with the demand discount quoted for the whole group.
+ * @param roomType Index into ROOM_TYPES
+ * @param roomCount Rooms wanted side by side
+ * @param guestName Name the group books under
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param hasBreakfast True to add breakfast to every room
+ * @param reservationIds Receives the reservation IDs, in room order
+ * @return Room number of the first room of the block, or -1 if no block
+ *         of that many free rooms exists (nothing is booked then)
+ */
+int reserveRoomBlock(int roomType, int roomCount, const string& guestName, int arrivalDay,
+                     int nights, bool hasBreakfast, vector<int>& reservationIds)
+{
+    OperationTimer timer(METRIC_RESERVE_BLOCK);
+    reservationIds.clear();
+    if (!isValidStay(arrivalDay, nights)) {
+        return -1;
+    }
+    
+    int first;
+    while (true) {
+        first = findRoomBlock(roomType, roomCount, arrivalDay, nights);
+        if (first == -1) {
+            return -1;
+        }
+        
+        // Take every room of the block, or give back what was taken
+        int claimed = 0;
+        while (claimed < roomCount && claimRoomNights(first + claimed, arrivalDay, nights)) {
+            claimed++;
+        }
+        if (claimed == roomCount) {
+            break;
+        }
+        for (int k = 0; k < claimed; k++) {
+            setRoomNights(first + k, arrivalDay, nights, true);
+        }
+        // Another booking took one of the rooms meanwhile: search again
+    }
+    
+    reservationIds.resize(roomCount);
+    generateReservationIds(roomCount, reservationIds.data());
+    int discountPercent = quoteDiscount(roomType, arrivalDay, nights);
+    
+    unique_lock<shared_mutex> lock(hotel->reservationLock);
+    for (int k = 0; k < roomCount; k++) {
+        storeReservation(first + k, reservationIds[k], guestName, arrivalDay, nights,
+                         discountPercent, hasBreakfast);
+    }
+    return roomNumberOf(first);
+}
+
+/**
+ * Cancels a reservation and frees its nights
+ * @param reservationId Reservation to cancel
+ * @return True if the reservation existed, false otherwise
+ */
+bool cancelReservation(int reservationId)
+{
+    OperationTimer timer(METRIC_CANCEL_RESERVATION);
+    unique_lock<shared_mutex> lock(hotel->reservationLock);
+    int slot = findReservationById(reservationId);
+    if (slot == -1) {
+        return false;
+    }
+    
+    unindexGuestName(slot);
+    addToTotals(slot, -1);
+    setRoomNights(reservedRoomOf(slot), arrivalDayOf(slot), nightsOf(slot), true);
+    releaseReservationSlot(slot);
+    
+    hotel->reservationIndex.erase(reservationId);
+    releaseReservationId(reservationId);
+    
+    if (hotel->journal.fd != -1 && !hotel->journal.replaying) {
+        string payload;
+        putValue(payload, hotel->journal.nextLsn);
+        putValue(payload, JOURNAL_CANCEL);
+        putValue(payload, int32_t(reservationId));
+        logJournalRecord(payload);
+    }
+    return true;
+}
+
+/**
+ * Moves a reservation to another room or stay
+ * The nights of the new stay are taken before the old ones are given
+ * back, so a change that cannot be made leaves the booking as it was.
+ * The discount given at booking is kept and the stay is repriced; the
+ * ID and name indexes are unaffected, and the calendar and totals change
+ * only for the nights involved.
+ * @param reservationId Reservation to change
+ * @param roomNumber New room of the same type, 0 for any other free room
+ *                   of that type, or -1 to keep the room
+ * @param arrivalDay New first night, or -1 to keep it
+ * @param nights New number of nights, or -1 to keep them
+ * @return True if the change was made; false if the reservation does not
+ *         exist, the new stay is not valid, the new room is of another
+ *         type or its nights are taken
+ */
+bool modifyReservation(int reservationId, int roomNumber, int arrivalDay, int nights)
+{
+    OperationTimer timer(METRIC_MODIFY_RESERVATION);
+    unique_lock<shared_mutex> lock(hotel->reservationLock);
+    int slot = findReservationById(reservationId);
+    if (slot == -1) {
+        return false;
+    }
+    
+    int oldRoom = reservedRoomOf(slot);
+    int oldArrival = arrivalDayOf(slot);
+    int oldNights = nightsOf(slot);
+    arrivalDay = (arrivalDay == -1) ? oldArrival : arrivalDay;
+    nights = (nights == -1) ? oldNights : nights;
+    if (!isValidStay(arrivalDay, nights) || roomNumber < -1 || roomNumber > hotel->totalRooms) {
+        return false;
+    }
+    
+    // Bookings take nights without reservationLock, so a picked room can
+    // still be lost to one of them
+    int newRoom = (roomNumber == -1) ? oldRoom : roomNumber - 1;
+    if (roomNumber > 0 && roomTypeOf(newRoom) != roomTypeOf(oldRoom)) {
+        return false; // Moves stay within the booked room type and its rate
+    }
+    while (true) {
+        if (roomNumber == 0) {
+            int picked = assignRandomRoom(roomTypeOf(oldRoom), arrivalDay, nights);
+            if (picked == -1) {
+                return false; // No other room of this type left for those nights
+            }
+            newRoom = picked - 1;
+        }
+        if (claimChangedNights(newRoom, arrivalDay, nights, oldRoom, oldArrival, oldNights)) {
+            break;
+        }
+        if (roomNumber != 0) {
+            return false;
+        }
+        // Another thread took the room first: pick again
+    }
+    
+    // Give back the old nights the new stay does not keep
+    addToTotals(slot, -1);
+    for (int d = oldArrival; d < oldArrival + oldNights; d++) {
+        if (newRoom != oldRoom || d < arrivalDay || d >= arrivalDay + nights) {
+            setRoomNights(oldRoom, d, 1, true);
+        }
+    }
+    ReservationStore& store = hotel->reservationStore;
+    store.roomIndex[slot] = newRoom;
+    store.arrivalDay[slot] = static_cast<int16_t>(arrivalDay);
+    store.nights[slot] = static_cast<uint8_t>(nights);
+    addToTotals(slot, +1);
+    
+    if (hotel->journal.fd != -1 && !hotel->journal.replaying) {
+        string payload;
+        putValue(payload, hotel->journal.nextLsn);
+        putValue(payload, JOURNAL_MODIFY);
+        putValue(payload, int32_t(reservationId));
+        putValue(payload, int32_t(newRoom));
+        putValue(payload, int16_t(arrivalDay));
+        putValue(payload, uint8_t(nights));
+        logJournalRecord(payload);
+    }
+    return true;
+}
+
+/**
+ * Takes the nights of a changed stay in one room; nights the reservation
+ * already holds in that room count as free and are kept as they are
+ * @param roomIndex Room of the new stay
+ * @param arrivalDay First night of the new stay
+ * @param nights Nights of the new stay
+ * @param heldRoom Room of the current stay
+ * @param heldArrival First night of the current stay
+ * @param heldNights Nights of the current stay
+ * @return True if every night was free or held and is now taken
+ */
+bool claimChangedNights(int roomIndex, int arrivalDay, int nights,
+                        int heldRoom, int heldArrival, int heldNights)
+{
+    auto held = [&](int day) {
+        return roomIndex == heldRoom && day >= heldArrival && day < heldArrival + heldNights;
+    };
+    
+    acquireRoomClaim(roomIndex);
+    bool free = true;
+    for (int d = arrivalDay; d < arrivalDay + nights && free; d++) {
+        free = held(d) || isRoomFreeFor(roomIndex, d, 1);
+    }
+    if (free) {
+        for (int d = arrivalDay; d < arrivalDay + nights; d++) {
+            if (!held(d)) setRoomNights(roomIndex, d, 1, false);
+        }
+    }
+    releaseRoomClaim(roomIndex);
+    return free;
+}
+
+/**
+ * Finds the slot holding a reservation (caller holds reservationLock)
+ * @param reservationId Reservation ID to look for
+ * @return Slot in reservations, or -1 if not found
+ */
+int findReservationById(int reservationId)
+{
+    auto it = hotel->reservationIndex.find(reservationId);
+    return (it != hotel->reservationIndex.end()) ? it->second : -1;
+}
+
+/**
+ * Finds all reservations whose guest name contains the search text
+ * (case-insensitive); the caller holds reservationLock, shared or not
+ * @param searchName Text to search for
+ * @return Slots in reservations, ordered by room and arrival day
+ */
+vector<int> findReservationsByName(const string& searchName)
+{
+    if (!__atomic_load_n(&hotel->nameIndex.built, __ATOMIC_ACQUIRE)) {
+        // Other readers may get here too; the first one builds it
+        lock_guard<mutex> build(hotel->nameIndexBuildLock);
+        if (!hotel->nameIndex.built) {
+            buildNameIndex();
+        }
+    }
+    
+    string needle = foldName(searchName);
+    vector<int> matches;
+    
+    // Too short for a trigram: check every active reservation's folded name
+    if (needle.size() < 3) {
+        for (int r = 0; r < reservationSlotCount(); r++) {
+            if (isActiveReservation(r) && foldedNameOf(r).find(needle) != string::npos) {
+                matches.push_back(r);
+            }
+        }
+        return sortedByRoom(matches);
+    }
+    
+    // Pick the shortest postings list among the query's trigrams
+    const vector<int>* candidates = nullptr;
+    for (size_t k = 0; k + 3 <= needle.size(); k++) {
+        uint32_t trigram = trigramAt(needle, k);
+        auto it = hotel->nameIndex.postings.find(trigram);
+        if (it == hotel->nameIndex.postings.end()) {
+            return matches; // Some trigram occurs in no name at all
+        }
+        if (candidates == nullptr || it->second.size() < candidates->size()) {
+            candidates = &it->second;
+        }
+    }
+    
+    // Every candidate holds that trigram; confirm the whole substring
+    for (int r : *candidates) {
+        if (foldedNameOf(r).find(needle) != string::npos) {
+            matches.push_back(r);
+        }
+    }
+    return sortedByRoom(matches);
+}
+
+/**
+ * Lowercases a guest name for case-insensitive comparison
+ * @param name Name as entered
+ * @return Folded copy of the name
+ */
+string foldName(string_view name)
+{
+    string folded(name);
+    for (char& c : folded) {
+        c = static_cast<char>(::tolower(static_cast<unsigned char>(c))); // Negative chars are undefined for tolower
+    }
+    return folded;
+}
+
+/**
+ * Packs three consecutive characters into a trigram key
+ * @param text Folded text
+ * @param pos Position of the first character
+ * @return Trigram key
+ */
+uint32_t trigramAt(string_view text, size_t pos)
+{
+    return (uint32_t(uint8_t(text[pos])) << 16) |
+           (uint32_t(uint8_t(text[pos+1])) << 8) |
+           uint32_t(uint8_t(text[pos+2]));
+}
+
+/**
+ * Adds a reservation's guest name to the name index
+ * @param slot Slot in reservations
+ */
+void indexGuestName(int slot)
+{
+    if (hotel->nameIndex.built) {
+        postGuestName(slot);
+    } // Otherwise picked up when the index is built
+}
+
+/**
+ * Adds a guest name's trigrams to the postings lists
+ * @param slot Slot in reservations
+ */
+void postGuestName(int slot)
+{
+    string_view folded = foldedNameOf(slot);
+    vector<pair<uint32_t, int>>& trigrams = hotel->nameIndex.slotTrigrams[slot];
+    trigrams.reserve(folded.size()); // One allocation, kept when the slot is reused
+    
+    for (size_t k = 0; k + 3 <= folded.size(); k++) {
+        uint32_t trigram = trigramAt(folded, k);
+        
+        // Post each distinct trigram of the name only once
+        bool seen = false;
+        for (const auto& entry : trigrams) {
+            if (entry.first == trigram) {
+                seen = true;
+                break;
+            }
+        }
+        if (seen) continue;
+        
+        vector<int>& list = hotel->nameIndex.postings[trigram];
+        trigrams.push_back({trigram, static_cast<int>(list.size())});
+        list.push_back(slot);
+    }
+}
+
+/**
+ * Indexes every active reservation (deferred after a snapshot load so
+ * that startup does not pay for it)
+ */
+void buildNameIndex()
+{
+    hotel->nameIndex.postings.clear();
+    hotel->nameIndex.slotTrigrams.assign(reservationSlotCount(), {});
+    for (int r = 0; r < reservationSlotCount(); r++) {
+        if (isActiveReservation(r)) {
+            postGuestName(r);
+        }
+    }
+    
+    // Publish only once complete: readers check the flag without a lock
+    __atomic_store_n(&hotel->nameIndex.built, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Removes a reservation's guest name from the name index
+ * Each postings entry is swap-removed, so the cost depends only on
+ * the length of the name, not on how many names share a trigram.
+ * @param slot Slot in reservations
+ */
+void unindexGuestName(int slot)
+{
+    if (!hotel->nameIndex.built) {
+        return;
+    }
+    
+    for (const auto& entry : hotel->nameIndex.slotTrigrams[slot]) {
+        auto it = hotel->nameIndex.postings.find(entry.first);
+        vector<int>& list = it->second;
+        
+        // Move the last entry into the freed position and fix its slot
+        int moved = list.back();
+        list[entry.second] = moved;
+        list.pop_back();
+        if (moved != slot) {
+            for (auto& movedEntry : hotel->nameIndex.slotTrigrams[moved]) {
+                if (movedEntry.first == entry.first) {
+                    movedEntry.second = entry.second;
+                    break;
+                }
+            }
+        }
+        if (list.empty()) {
+            hotel->nameIndex.postings.erase(it);
+        }
+    }
+    hotel->nameIndex.slotTrigrams[slot].clear();
+}
+
+// ---- Room store accessors (roomIndex = room number - 1) ----
+
+int roomNumberOf(int roomIndex)
+{
+    return roomIndex + 1;
+}
+
+// @return Index into ROOM_TYPES
+int roomTypeOf(int roomIndex)
+{
+    return hotel->roomStore.type[roomIndex];
+}
+
+// @return Number of rooms of a type
+int roomCountOfType(int roomType)
+{
+    return hotel->firstRoomOfType[roomType + 1] - hotel->firstRoomOfType[roomType];
+}
+
+int32_t roomBasePrice(int roomIndex)
+{
+    return hotel->roomStore.basePriceCents[roomIndex];
+}
+
+// ---- Reservation store accessors (slot = index into the columns) ----
+
+int reservationSlotCount()
+{
+    return static_cast<int>(hotel->reservationStore.status.size());
+}
+
+bool isActiveReservation(int slot)
+{
+    return (hotel->reservationStore.status[slot] & RES_ACTIVE) != 0;
+}
+
+int reservationIdOf(int slot)
+{
+    return hotel->reservationStore.reservationId[slot];
+}
+
+int reservedRoomOf(int slot)
+{
+    return hotel->reservationStore.roomIndex[slot];
+}
+
+int arrivalDayOf(int slot)
+{
+    return hotel->reservationStore.arrivalDay[slot];
+}
+
+int nightsOf(int slot)
+{
+    return hotel->reservationStore.nights[slot];
+}
+
+int discountOf(int slot)
+{
+    return hotel->reservationStore.discountPercent[slot];
+}
+
+bool includesBreakfast(int slot)
+{
+    return (hotel->reservationStore.status[slot] & RES_BREAKFAST) != 0;
+}
+
+string_view guestNameOf(int slot)
+{
+    const GuestNamePool& pool = hotel->reservationStore.guestNames;
+    uint32_t handle = hotel->reservationStore.guestHandle[slot];
+    return string_view(pool.text[handle], pool.length[handle]);
+}
+
+// Lowercased guest name, as matched by name searches
+string_view foldedNameOf(int slot)
+{
+    const GuestNamePool& pool = hotel->reservationStore.guestNames;
+    uint32_t handle = hotel->reservationStore.guestHandle[slot];
+    return string_view(pool.text[handle] + pool.length[handle], pool.length[handle]);
+}
+
+/**
+ * Points a reservation at its guest's interned name
+ * @param slot Slot index
+ * @param guestName Name of guest
+ */
+void setGuestName(int slot, string_view guestName)
+{
+    hotel->reservationStore.guestHandle[slot] = internGuestName(guestName);
+}
+
+/**
+ * Takes a reference to a guest name, adding it to the pool if it is new
+ * The caller holds reservationLock exclusively.
+ * @param name Name of guest
+ * @return Handle of the name
+ */
+uint32_t internGuestName(string_view name)
+{
+    GuestNamePool& pool = hotel->reservationStore.guestNames;
+    auto it = pool.handles.find(name);
+    if (it != pool.handles.end()) {
+        pool.references[it->second]++;
+        return it->second;
+    }
+    
+    // Store the name and its folded key side by side
+    char* text = allocateGuestBytes(2 * name.size());
+    memcpy(text, name.data(), name.size());
+    for (size_t k = 0; k < name.size(); k++) {
+        text[name.size() + k] = static_cast<char>(::tolower(static_cast<unsigned char>(name[k])));
+    }
+    pool.liveBytes += 2 * name.size();
+    
+    uint32_t handle;
+    if (!pool.freeHandles.empty()) {
+        handle = pool.freeHandles.back();
+        pool.freeHandles.pop_back();
+    } else {
+        handle = static_cast<uint32_t>(pool.text.size());
+        pool.text.push_back(nullptr);
+        pool.length.push_back(0);
+        pool.references.push_back(0);
+    }
+    pool.text[handle] = text;
+    pool.length[handle] = static_cast<uint32_t>(name.size());
+    pool.references[handle] = 1;
+    pool.handles.emplace(string_view(text, name.size()), handle);
+    return handle;
+}
+
+/**
+ * Drops a reference to a guest name; the last one frees the handle
+ * Once more than half of the arena belongs to freed names, the arena is
+ * compacted. The caller holds reservationLock exclusively.
+ * @param handle Handle from internGuestName
+ */
+void releaseGuestName(uint32_t handle)
+{
+    GuestNamePool& pool = hotel->reservationStore.guestNames;
+    if (--pool.references[handle] > 0) {
+        return;
+    }
+    pool.handles.erase(string_view(pool.text[handle], pool.length[handle]));
+    pool.liveBytes -= 2 * pool.length[handle];
+    pool.freeHandles.push_back(handle);
+    
+    if (pool.arenaBytes > GUEST_ARENA_BLOCK && pool.arenaBytes > 2 * pool.liveBytes) {
+        compactGuestNames();
+    }
+}
+
+/**
+ * Reserves bytes in the guest arena, starting a new block when needed
+ * @param size Bytes wanted
+ * @return Start of the bytes (valid until the next compaction)
+ */
+char* allocateGuestBytes(size_t size)
+{
+    GuestNamePool& pool = hotel->reservationStore.guestNames;
+    if (pool.blocks.empty() || pool.blockUsed + size > pool.blockSize) {
+        pool.blockSize = max(GUEST_ARENA_BLOCK, size);
+        pool.blocks.emplace_back(new char[pool.blockSize]);
+        pool.blockUsed = 0;
+    }
+    char* bytes = pool.blocks.back().get() + pool.blockUsed;
+    pool.blockUsed += size;
+    pool.arenaBytes += size;
+    return bytes;
+}
+
+/**
+ * Copies the referenced names into a fresh arena; handles stay the same
+ */
+void compactGuestNames()
+{
+    GuestNamePool& pool = hotel->reservationStore.guestNames;
+    vector<unique_ptr<char[]>> oldBlocks;
+    oldBlocks.swap(pool.blocks);
+    pool.blockUsed = pool.blockSize = pool.arenaBytes = 0;
+    pool.handles.clear();
+    
+    for (size_t handle = 0; handle < pool.text.size(); handle++) {
+        if (pool.references[handle] == 0) {
+            continue;
+        }
+        char* text = allocateGuestBytes(2 * pool.length[handle]);
+        memcpy(text, pool.text[handle], 2 * pool.length[handle]);
+        pool.text[handle] = text;
+        pool.handles.emplace(string_view(text, pool.length[handle]), static_cast<uint32_t>(handle));
+    }
+}
+
+/**
+ * Gets an empty reservation slot, reusing a cancelled one if possible
+ * @return Slot index (all columns, including the name index, cover it)
+ */
+int allocateReservationSlot()
+{
+    ReservationStore& store = hotel->reservationStore;
+    if (!store.freeSlots.empty()) {
+        int slot = store.freeSlots.back();
+        store.freeSlots.pop_back();
+        return slot;
+    }
+    
+    // Grow every column by one
+    store.status.push_back(0);
+    store.roomIndex.push_back(0);
+    store.arrivalDay.push_back(0);
+    store.nights.push_back(0);
+    store.reservationId.push_back(0);
+    store.discountPercent.push_back(0);
+    store.guestHandle.push_back(0);
+    hotel->nameIndex.slotTrigrams.emplace_back();
+    return reservationSlotCount() - 1;
+}
+
+/**
+ * Marks a reservation slot as unused so it can be handed out again
+ * @param slot Slot index
+ */
+void releaseReservationSlot(int slot)
+{
+    ReservationStore& store = hotel->reservationStore;
+    store.status[slot] = 0;
+    releaseGuestName(store.guestHandle[slot]);
+    store.freeSlots.push_back(slot);
+}
+
+/**
+ * Checks that a stay fits within the booking horizon
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return True if the stay can be booked
+ */
+bool isValidStay(int arrivalDay, int nights)
+{
+    return arrivalDay >= 0 && nights >= 1 && nights <= MAX_NIGHTS &&
+           arrivalDay + nights <= CALENDAR_DAYS;
+}
+
+/**
+ * Checks whether a room is free on every night of a stay
+ * @param roomIndex Index into rooms
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return True if no other reservation holds any of those nights
+ */
+bool isRoomFreeFor(int roomIndex, int arrivalDay, int nights)
+{
+    const uint64_t* row = &hotel->calendar.freeBits[size_t(arrivalDay) * hotel->calendar.wordsPerDay];
+    uint64_t bit = uint64_t(1) << (roomIndex % 64);
+    for (int d = 0; d < nights; d++, row += hotel->calendar.wordsPerDay) {
+        if ((__atomic_load_n(&row[roomIndex / 64], __ATOMIC_ACQUIRE) & bit) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Marks the nights of a stay as free or taken for one room
+ * Words are shared with 63 other rooms, so bits change atomically.
+ * Only a thread holding the room's claim may take nights.
+ * @param roomIndex Index into rooms
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param free True to release the nights, false to take them
+ */
+void setRoomNights(int roomIndex, int arrivalDay, int nights, bool free)
+{
+    uint64_t* row = &hotel->calendar.freeBits[size_t(arrivalDay) * hotel->calendar.wordsPerDay];
+    uint64_t bit = uint64_t(1) << (roomIndex % 64);
+    for (int d = 0; d < nights; d++, row += hotel->calendar.wordsPerDay) {
+        if (free) {
+            __atomic_fetch_or(&row[roomIndex / 64], bit, __ATOMIC_RELEASE);
+        } else {
+            __atomic_fetch_and(&row[roomIndex / 64], ~bit, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/**
+ * Builds the set of rooms of a type that are free on every night of a stay
+ * Rooms of a type are consecutive, so only the calendar words holding
+ * that type are read; the mask starts at the type's first word.
+ * @param roomType Index into ROOM_TYPES
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @param mask Receives one bit per room of the type's words (set = free
+ *             for the whole stay)
+ * @return Room index of the mask's bit 0
+ */
+int freeRoomsMask(int roomType, int arrivalDay, int nights, vector<uint64_t>& mask)
+{
+    int begin = hotel->firstRoomOfType[roomType];
+    int end = hotel->firstRoomOfType[roomType + 1];
+    if (begin == end) {
+        mask.clear();
+        return begin;
+    }
+    
+    int firstWord = begin / 64;
+    int words = (end - 1) / 64 - firstWord + 1;
+    const vector<uint64_t>& typeMask = hotel->calendar.typeMask[roomType];
+    mask.assign(typeMask.begin() + firstWord, typeMask.begin() + firstWord + words);
+    const uint64_t* row = &hotel->calendar.freeBits[size_t(arrivalDay) * hotel->calendar.wordsPerDay + firstWord];
+    for (int d = 0; d < nights; d++, row += hotel->calendar.wordsPerDay) {
+        for (int w = 0; w < words; w++) {
+            mask[w] &= __atomic_load_n(&row[w], __ATOMIC_RELAXED);
+        }
+    }
+    return firstWord * 64;
+}
+
+/**
+ * Finds the next set bit of a room mask
+ * @param mask One bit per room
+ * @param fromIndex First room index to consider
+ * @return Room index, or -1 if no bit is set at or after fromIndex
+ */
+int nextSetBit(const vector<uint64_t>& mask, int fromIndex)
+{
+    size_t w = fromIndex / 64;
+    if (w >= mask.size()) {
+        return -1;
+    }
+    
+    // Mask off rooms before fromIndex, then skip empty words
+    uint64_t word = mask[w] & (~uint64_t(0) << (fromIndex % 64));
+    while (word == 0) {
+        if (++w == mask.size()) {
+            return -1;
+        }
+        word = mask[w];
+    }
+    return static_cast<int>(w * 64) + __builtin_ctzll(word);
+}
+
+/**
+ * Counts the set bits of a room mask
+ * @param mask One bit per room
+ * @return Number of rooms in the mask
+ */
+int countSetBits(const vector<uint64_t>& mask)
+{
+    int count = 0;
+    for (uint64_t word : mask) {
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+/**
+ * Finds the room holding a given rank among the set bits of a mask
+ * @param mask One bit per room
+ * @param rank Zero-based rank (must be below countSetBits(mask))
+ * @return Room index
+ */
+int selectSetBit(const vector<uint64_t>& mask, int rank)
+{
+    // Skip whole words by popcount, then clear low bits within the word
+    size_t w = 0;
+    int inWord;
+    while (rank >= (inWord = __builtin_popcountll(mask[w]))) {
+        rank -= inWord;
+        w++;
+    }
+    uint64_t word = mask[w];
+    for (int k = 0; k < rank; k++) {
+        word &= word - 1;
+    }
+    return static_cast<int>(w * 64) + __builtin_ctzll(word);
+}
+
+/**
+ * Orders reservation slots by room number, then by arrival day
+ * @param slots Slots in reservations
+ * @param first First position that must be in order (a page's start)
+ * @param last End of the positions that must be in order; positions
+ *             outside [first, last) hold the other slots, unordered
+ * @return The same slots, sorted
+ */
+vector<int> sortedByRoom(vector<int> slots, size_t first, size_t last)
+{
+    // Sort packed (room, day) keys paired with the slot: the room takes
+    // the high 32 bits, so every room index of an int keeps its order
+    vector<pair<uint64_t, int>> keys(slots.size());
+    for (size_t k = 0; k < slots.size(); k++) {
+        keys[k] = {(uint64_t(reservedRoomOf(slots[k])) << 32) | uint32_t(arrivalDayOf(slots[k])), slots[k]};
+    }
+    last = min(last, keys.size());
+    if (first == 0 && last == keys.size()) {
+        sort(keys.begin(), keys.end());
+    } else if (first < last) {
+        // A page: put its keys in place, then order just those
+        nth_element(keys.begin(), keys.begin() + first, keys.end());
+        partial_sort(keys.begin() + first, keys.begin() + last, keys.end());
+    }
+    for (size_t k = 0; k < slots.size(); k++) {
+        slots[k] = keys[k].second;
+    }
+    return slots;
+}
+
+/**
+ * Total paid for a reservation, under its room type's pricing policy
+ * @param slot Slot in reservations
+ * @return Final price in cents
+ */
+int64_t reservationTotal(int slot)
+{
+    return calculateFinalPrice(reservedRoomOf(slot) + 1, arrivalDayOf(slot), nightsOf(slot),
+                               discountOf(slot), includesBreakfast(slot));
+}
+
+/**
+ * Adds a reservation to the running totals, or removes it
+ * The caller holds reservationLock exclusively.
+ * @param slot Active reservation
+ * @param sign +1 when booked, -1 when cancelled
+ */
+void addToTotals(int slot, int sign)
+{
+    HotelTotals& totals = hotel->totals;
+    int type = roomTypeOf(reservedRoomOf(slot));
+    totals.reservations[type] += sign;
+    totals.roomNights[type] += sign * nightsOf(slot);
+    for (int d = arrivalDayOf(slot); d < arrivalDayOf(slot) + nightsOf(slot); d++) {
+        totals.bookedPerDay[type][d] += sign;
+    }
+    updateRates(type, arrivalDayOf(slot), arrivalDayOf(slot) + nightsOf(slot));
+    totals.revenueCents += sign * reservationTotal(slot);
+    totals.discountBasisPoints += sign * discountOf(slot) * 100;
+    totals.breakfasts += sign * (includesBreakfast(slot) ? 1 : 0);
+}
+
+/**
+ * Recomputes the running totals from the reservations (after a snapshot
+ * load, which bypasses the booking path)
+ */
+void rebuildTotals()
+{
+    hotel->totals = HotelTotals();
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        hotel->totals.bookedPerDay[t].assign(CALENDAR_DAYS, 0);
+    }
+    for (int r = 0; r < reservationSlotCount(); r++) {
+        if (isActiveReservation(r)) {
+            addToTotals(r, +1);
+        }
+    }
+    rebuildRates(); // Nights without reservations too
+}
+
+/**
+ * Computes the demand discount of one night from the running totals
+ * @param roomType Index into ROOM_TYPES
+ * @param day Night (0 = tonight; also its lead time in days)
+ * @return Discount in percent
+ */
+int nightDiscount(int roomType, int day)
+{
+    int rooms = roomCountOfType(roomType);
+    int occupancyPercent = (rooms > 0) ? hotel->totals.bookedPerDay[roomType][day] * 100 / rooms : 0;
+    int pacePercent = PACE_TARGET_PERCENT * max(0, PACE_HORIZON_DAYS - day) / PACE_HORIZON_DAYS;
+    int demandPercent = occupancyPercent + (occupancyPercent - pacePercent) * PACE_WEIGHT_PERCENT / 100;
+    demandPercent = min(100, max(0, demandPercent));
+    return ROOM_TYPES[roomType].pricing.maxDemandDiscountPercent * (100 - demandPercent) / 100;
+}
+
+/**
+ * Recomputes the demand discounts of a range of nights of one room type
+ * The caller holds reservationLock exclusively.
+ * @param roomType Index into ROOM_TYPES
+ * @param firstDay First night to update
+ * @param endDay Night after the last one to update
+ */
+void updateRates(int roomType, int firstDay, int endDay)
+{
+    uint8_t* nightly = hotel->rates.discountPercent[roomType];
+    for (int d = firstDay; d < endDay; d++) {
+        __atomic_store_n(&nightly[d], static_cast<uint8_t>(nightDiscount(roomType, d)), __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Recomputes every demand discount (when the totals are reset)
+ */
+void rebuildRates()
+{
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        updateRates(t, 0, CALENDAR_DAYS);
+    }
+}
+
+/**
+ * Quotes the demand discount for a stay: the mean of its nights' rates
+ * Reads the rate table without a lock.
+ * @param roomType Index into ROOM_TYPES
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return Discount in percent, rounded to the nearest whole percent
+ */
+int quoteDiscount(int roomType, int arrivalDay, int nights)
+{
+    const uint8_t* nightly = &hotel->rates.discountPercent[roomType][arrivalDay];
+    int sum = 0;
+    for (int d = 0; d < nights; d++) {
+        sum += __atomic_load_n(&nightly[d], __ATOMIC_RELAXED);
+    }
+    return (sum + nights / 2) / nights;
+}
+
+/**
+ * Prints occupancy and revenue figures from the running totals (O(1))
+ * The caller holds reservationLock, shared or not.
+ * @param out Stream receiving the summary
+ * @param day Day whose occupancy is shown (0 = tonight)
+ */
+void writeSummary(ostream& out, int day)
+{
+    const HotelTotals& totals = hotel->totals;
+    int reservations = 0;
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        reservations += totals.reservations[t];
+    }
+    
+    out << "SUMMARY day " << day << "\n";
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        int booked = totals.bookedPerDay[t][day];
+        out << "  " << ROOM_TYPES[t].name << ": " << booked << " booked, " << (roomCountOfType(t) - booked)
+            << " available; " << totals.reservations[t] << " reservations, "
+            << totals.roomNights[t] << " room-nights\n";
+    }
+    out << "  revenue: " << formatCents(totals.revenueCents) << " EUR\n";
+    
+    // Later output on the same stream (stats, server replies) keeps its format
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(2)
+        << "  average discount: " << (reservations ? totals.discountBasisPoints / 100.0 / reservations : 0.0) << "%\n"
+        << "  breakfast: " << totals.breakfasts << " of " << reservations << " reservations ("
+        << (reservations ? 100.0 * totals.breakfasts / reservations : 0.0) << "%)\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+/**
+ * Executes one batch command and writes its result
+ * Commands (one per line, '#' starts a comment; days count from 0 = tonight):
+ *   book <room type> <room|any> <arrival day> <nights> <breakfast yes|no> <guest name>
+ *                             (room type: a name from ROOM_TYPES, e.g. single, suite)
+ *   book-block <room type> <rooms> <arrival day> <nights> <breakfast yes|no> <group name>
+ *                             (that many adjacent rooms, all or none)
+ *   quote <room type> <arrival day> <nights>  (demand discount and price of a stay)
+ *   search-id <reservation id>
+ *   search-name <text>
+ *   list-available [<arrival day> <nights>]
+ *   view [<filters>]          (filters: type=<room type> breakfast=yes|no discount=N
+ *                              offset=N limit=N)
+ *   export <csv|json> <file> [<filters>]  (all matching reservations, in one pass;
+ *                             batch mode only, refused over the server)
+ *   import <csv|json> <file> [<error file>]  (book every record of a feed in the export
+ *                             format; refused records are listed by line;
+ *                             batch mode only, refused over the server)
+ *   cancel <reservation id>
+ *   change-nights <reservation id> <nights>  (extend or shorten; same arrival and room)
+ *   change-room <reservation id> <room|any>  (move the stay to a room of its type; any = pick one)
+ *   summary [<day>]           (occupancy on that day, revenue, discounts, breakfast)
+ *   revenue                   (end-of-day revenue, repriced from every reservation)
+ *   stats                     (metrics in Prometheus text format)
+ *   snapshot                  (write a snapshot now; needs --data-dir)
+ * @param line Command text
+ * @param out Stream receiving the result
+ * @return False if the command could not be parsed
+ */
+bool executeCommand(const string& line, ostream& out)
+{
+    istringstream args(line);
+    string command;
+    if (!(args >> command) || command[0] == '#') {
+        return true; // Blank line or comment
+    }
+    
+    if (command == "book") {
+        string type, room, breakfast, guestName;
+        int arrivalDay = -1, nights = 0;
+        args >> type >> room >> arrivalDay >> nights >> breakfast;
+        getline(args >> ws, guestName);
+        
+        int roomType = roomTypeNamed(type);
+        bool validBreakfast = (breakfast == "yes" || breakfast == "no");
+        int roomNumber = (room == "any") ? 0 : atoi(room.c_str());
+        if (roomType == -1 || !validBreakfast || roomNumber < 0 ||
+            !isValidStay(arrivalDay, nights) || guestName.empty()) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        int reservationId = reserveRoom(roomType, roomNumber, guestName,
+                                        arrivalDay, nights, breakfast == "yes");
+        if (reservationId == -1) {
+            out << "FAILED book " << type << " " << room << "\n";
+        } else {
+            shared_lock<shared_mutex> lock(hotel->reservationLock);
+            int r = findReservationById(reservationId);
+            out << "BOOKED " << reservationId;
+            if (r != -1) { // Not already cancelled by another thread
+                out << " room " << roomNumberOf(reservedRoomOf(r))
+                    << " total " << formatCents(reservationTotal(r));
+            }
+            out << "\n";
+        }
+    } else if (command == "book-block") {
+        string type, breakfast, guestName;
+        int roomCount = 0, arrivalDay = -1, nights = 0;
+        args >> type >> roomCount >> arrivalDay >> nights >> breakfast;
+        getline(args >> ws, guestName);
+        
+        int roomType = roomTypeNamed(type);
+        if (roomType == -1 || roomCount < 1 || (breakfast != "yes" && breakfast != "no") ||
+            !isValidStay(arrivalDay, nights) || guestName.empty()) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        vector<int> reservationIds;
+        int firstRoom = reserveRoomBlock(roomType, roomCount, guestName, arrivalDay, nights,
+                                         breakfast == "yes", reservationIds);
+        if (firstRoom == -1) {
+            out << "FAILED book-block " << type << " " << roomCount << "\n";
+        } else {
+            shared_lock<shared_mutex> lock(hotel->reservationLock);
+            int64_t total = 0;
+            for (int reservationId : reservationIds) {
+                int r = findReservationById(reservationId);
+                total += (r != -1) ? reservationTotal(r) : 0; // Unless already cancelled
+            }
+            out << "BOOKED " << roomCount << " rooms " << firstRoom << "-" << firstRoom + roomCount - 1
+                << " total " << formatCents(total) << " ids";
+            for (int reservationId : reservationIds) {
+                out << " " << reservationId;
+            }
+            out << "\n";
+        }
+    } else if (command == "quote") {
+        string type;
+        int arrivalDay = -1, nights = 0;
+        args >> type >> arrivalDay >> nights;
+        int roomType = roomTypeNamed(type);
+        if (roomType == -1 || !isValidStay(arrivalDay, nights) || roomCountOfType(roomType) == 0) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        int discount = quoteDiscount(roomType, arrivalDay, nights);
+        out << "QUOTE " << type << " discount " << discount << "% total "
+            << formatCents(calculateFinalPrice(hotel->firstRoomOfType[roomType] + 1, arrivalDay, nights,
+                                               discount, false))
+            << " EUR nightly";
+        for (int d = arrivalDay; d < arrivalDay + nights; d++) {
+            out << " " << int(__atomic_load_n(&hotel->rates.discountPercent[roomType][d], __ATOMIC_RELAXED));
+        }
+        out << "\n";
+    } else if (command == "search-id" || command == "cancel") {
+        int reservationId;
+        if (!(args >> reservationId)) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        if (command == "cancel") {
+            out << (cancelReservation(reservationId) ? "CANCELLED " : "NOT FOUND ")
+                << reservationId << "\n";
+            return true;
+        }
+        
+        OperationTimer timer(METRIC_SEARCH_RESERVATION);
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        int r = findReservationById(reservationId);
+        if (r == -1) {
+            out << "NOT FOUND " << reservationId << "\n";
+        } else {
+            out << "FOUND " << reservationId << " room " << roomNumberOf(reservedRoomOf(r))
+                << " arrival " << arrivalDayOf(r) << " nights " << nightsOf(r)
+                << " total " << formatCents(reservationTotal(r))
+                << " guest " << guestNameOf(r) << "\n";
+        }
+    } else if (command == "search-name") {
+        string searchName;
+        getline(args >> ws, searchName);
+        
+        OperationTimer timer(METRIC_SEARCH_RESERVATION);
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        vector<int> matches = findReservationsByName(searchName);
+        out << "FOUND " << matches.size() << "\n";
+        for (int r : matches) {
+            out << "  " << reservationIdOf(r) << " room " << roomNumberOf(reservedRoomOf(r))
+                << " arrival " << arrivalDayOf(r) << " guest " << guestNameOf(r) << "\n";
+        }
+    } else if (command == "change-nights" || command == "change-room") {
+        int reservationId = 0, nights = -1, roomNumber = -1;
+        string room;
+        bool parsed = static_cast<bool>(args >> reservationId);
+        if (command == "change-nights") {
+            parsed = parsed && (args >> nights) && nights >= 1;
+        } else {
+            parsed = parsed && (args >> room);
+            roomNumber = (room == "any") ? 0 : atoi(room.c_str());
+            parsed = parsed && (room == "any" || roomNumber >= 1);
+        }
+        if (!parsed) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        bool changed = modifyReservation(reservationId, roomNumber, -1, nights);
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        int r = findReservationById(reservationId);
+        if (r == -1) {
+            out << "NOT FOUND " << reservationId << "\n";
+        } else if (!changed) {
+            out << "FAILED " << command << " " << reservationId << "\n";
+        } else {
+            out << "CHANGED " << reservationId << " room " << roomNumberOf(reservedRoomOf(r))
+                << " arrival " << arrivalDayOf(r) << " nights " << nightsOf(r)
+                << " total " << formatCents(reservationTotal(r)) << "\n";
+        }
+    } else if (command == "list-available") {
+        int arrivalDay = 0, nights = 1;
+        if (args >> arrivalDay && !(args >> nights)) {
+            nights = -1; // Arrival given without nights
+        }
+        if (!isValidStay(arrivalDay, nights)) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        displayAvailableRooms(out, arrivalDay, nights);
+    } else if (command == "view") {
+        ReportQuery query;
+        if (!parseReportQuery(args, query)) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        viewReservations(out, query);
+    } else if (command == "export") {
+        string formatName, path;
+        ReportQuery query;
+        args >> formatName >> path;
+        if ((formatName != "csv" && formatName != "json") || path.empty() ||
+            !parseReportQuery(args, query)) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        int listed = 0;
+        ofstream file(path, ios::binary | ios::trunc);
+        if (file) {
+            shared_lock<shared_mutex> lock(hotel->reservationLock);
+            writeReservationReport(file, query, formatName == "csv" ? REPORT_CSV : REPORT_JSON, listed);
+        }
+        file.close();
+        out << (file ? "EXPORTED " : "FAILED export ") << listed << " " << path << "\n";
+    } else if (command == "import") {
+        string formatName, path, errorPath;
+        args >> formatName >> path >> errorPath;
+        if ((formatName != "csv" && formatName != "json") || path.empty()) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        ImportReport report;
+        if (!importReservations(path, formatName == "csv" ? REPORT_CSV : REPORT_JSON, report)) {
+            out << "FAILED import " << path << ": " << report.failure << "\n";
+            return true;
+        }
+        out << "IMPORTED " << report.imported << " of " << report.records << " " << path << "\n";
+        
+        // Every refusal goes to the error file; the reply shows the first few
+        int shown = static_cast<int>(report.refused.size());
+        if (!errorPath.empty()) {
+            ofstream errors(errorPath, ios::binary | ios::trunc);
+            for (const auto& refusal : report.refused) {
+                errors << "line " << refusal.first << ": " << refusal.second << "\n";
+            }
+            if (!errors) {
+                out << "  FAILED writing " << errorPath << "\n";
+            }
+            shown = 0;
+        }
+        shown = min(shown, IMPORT_ERRORS_SHOWN);
+        for (int k = 0; k < shown; k++) {
+            out << "  line " << report.refused[k].first << ": " << report.refused[k].second << "\n";
+        }
+        if (shown < static_cast<int>(report.refused.size()) && errorPath.empty()) {
+            out << "  ... " << report.refused.size() - shown << " more\n";
+        }
+    } else if (command == "summary") {
+        int day = 0;
+        if (args >> day && (day < 0 || day >= CALENDAR_DAYS)) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        writeSummary(out, day);
+    } else if (command == "revenue") {
+        shared_lock<shared_mutex> lock(hotel->reservationLock);
+        int reservations = 0;
+        int64_t revenue = totalRevenue(reservations);
+        out << "REVENUE " << formatCents(revenue) << " EUR reservations " << reservations << "\n";
+    } else if (command == "stats") {
+        writeStatsText(out);
+    } else if (command == "snapshot") {
+        if (hotel->journal.fd == -1) {
+            out << "ERROR snapshot needs --data-dir\n";
+            return false;
+        }
+        unique_lock<shared_mutex> lock(hotel->reservationLock);
+        out << (writeSnapshot() ? "SNAPSHOT " : "FAILED snapshot ") << hotel->reservationIndex.size() << "\n";
+    } else {
+        out << "ERROR unknown command: " << command << "\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Runs batch commands until end of input
+ * @param in Stream of commands, one per line
+ */
+void runBatch(istream& in)
+{
+    string line;
+    while (getline(in, line)) {
+        executeRequest(line, cout);
+    }
+    cout.flush();
+}
+
+/**
+ * Books every record of a reservation feed: CSV with a header line, or
+ * JSON with one object per line, as written by export. Reservation IDs
+ * and totals in the feed are ignored; each record gets a fresh ID and is
+ * priced like any other booking. Records naming a room are booked before
+ * those that let the system choose one, and when two records name the
+ * same room for the same night, the earlier line gets it.
+ * @param path Feed file
+ * @param format REPORT_CSV or REPORT_JSON
+ * @param report Receives the counts and the refused records
+ * @return False if the file could not be read or lacks a required column
+ */
+bool importReservations(const string& path, int format, ImportReport& report)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) != 0) {
+        if (fd != -1) close(fd);
+        report.failure = "cannot read file";
+        return false;
+    }
+    size_t fileSize = info.st_size;
+    if (fileSize == 0) {
+        close(fd);
+        return true; // Nothing to import
+    }
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        report.failure = "cannot map file";
+        return false;
+    }
+    string_view text(static_cast<const char*>(mapping), fileSize);
+    
+    // A CSV feed names its columns in the first line
+    int columns[IMPORT_FIELDS];
+    fill(columns, columns + IMPORT_FIELDS, -1);
+    size_t start = 0;
+    int linesBefore = 0;
+    if (format == REPORT_CSV) {
+        size_t end = min(text.find('\n'), text.size());
+        string_view header = text.substr(0, end);
+        if (!header.empty() && header.back() == '\r') header.remove_suffix(1);
+        vector<string> cells;
+        int cellCount = 0;
+        splitCsvLine(header, cells, cellCount);
+        for (int c = 0; c < cellCount; c++) {
+            for (int f = 0; f < IMPORT_FIELDS; f++) {
+                if (cells[c] == IMPORT_FIELD_NAMES[f]) columns[f] = c;
+            }
+        }
+        for (int f : {IMPORT_TYPE, IMPORT_GUEST, IMPORT_ARRIVAL, IMPORT_NIGHTS}) {
+            if (columns[f] == -1) {
+                report.failure = string("missing column ") + IMPORT_FIELD_NAMES[f];
+                munmap(mapping, fileSize);
+                return false;
+            }
+        }
+        start = min(end + 1, text.size());
+        linesBefore = 1;
+    }
+    
+    // Cut the rest into one chunk of whole lines per thread
+    size_t bodySize = text.size() - start;
+    int chunkCount = static_cast<int>(min<size_t>(max(1u, thread::hardware_concurrency()),
+                                                  bodySize / IMPORT_MIN_CHUNK + 1));
+    vector<size_t> bounds(chunkCount + 1, text.size());
+    bounds[0] = start;
+    for (int k = 1; k < chunkCount; k++) {
+        size_t newline = text.find('\n', max(bounds[k-1], start + bodySize * k / chunkCount));
+        bounds[k] = (newline == string_view::npos) ? text.size() : newline + 1;
+    }
+    
+    // Parse and check every line
+    vector<vector<ImportRecord>> chunks(chunkCount);
+    vector<int> chunkLines(chunkCount);
+    runInParallel(chunkCount, [&](int k) {
+        chunkLines[k] = parseImportChunk(text.substr(bounds[k], bounds[k+1] - bounds[k]),
+                                         format, columns, chunks[k]);
+    });
+    for (int k = 0; k < chunkCount; k++) {
+        for (ImportRecord& record : chunks[k]) {
+            record.line += linesBefore;
+        }
+        linesBefore += chunkLines[k];
+    }
+    
+    // Claim the named rooms. Each thread owns the rooms of every
+    // chunkCount-th calendar word and goes through the records in file
+    // order, so the outcome does not depend on thread timing.
+    runInParallel(chunkCount, [&](int k) {
+        for (vector<ImportRecord>& chunk : chunks) {
+            for (ImportRecord& record : chunk) {
+                if (record.roomNumber != 0 && (record.roomNumber - 1) / 64 % chunkCount == k &&
+                    record.error == nullptr &&
+                    !claimRoomNights(record.roomNumber - 1, record.arrivalDay, record.nights)) {
+                    record.error = "room already booked for those nights";
+                }
+            }
+        }
+    });
+    
+    // Then pick rooms for the others, each thread for its own chunk
+    runInParallel(chunkCount, [&](int k) {
+        for (ImportRecord& record : chunks[k]) {
+            if (record.error == nullptr && record.roomNumber == 0) {
+                record.roomNumber = claimRandomRoom(record.roomType, record.arrivalDay, record.nights);
+                if (record.roomNumber == -1) {
+                    record.roomNumber = 0;
+                    record.error = "no room of that type free for those nights";
+                }
+            }
+        }
+    });
+    
+    // Store the claimed records in file order, a batch per hold of the
+    // lock. The IDs of the next batch are drawn while a batch is stored.
+    vector<const ImportRecord*> accepted;
+    for (const vector<ImportRecord>& chunk : chunks) {
+        for (const ImportRecord& record : chunk) {
+            if (record.error != nullptr) {
+                report.refused.push_back({record.line, record.error});
+            } else {
+                accepted.push_back(&record);
+            }
+        }
+        report.records += static_cast<int>(chunk.size());
+    }
+    int acceptedCount = static_cast<int>(accepted.size());
+    vector<int> batchIds[2] = {vector<int>(IMPORT_BATCH), vector<int>(IMPORT_BATCH)};
+    generateReservationIds(min(IMPORT_BATCH, acceptedCount), batchIds[0].data());
+    
+    unique_lock<shared_mutex> lock(hotel->reservationLock);
+    if (hotel->nameIndex.built && acceptedCount > 0 &&
+        size_t(acceptedCount) >= hotel->reservationIndex.size()) {
+        // Cheaper to rebuild on the next name search than to post each name
+        __atomic_store_n(&hotel->nameIndex.built, false, __ATOMIC_RELEASE);
+        hotel->nameIndex.postings.clear();
+    }
+    hotel->reservationIndex.reserve(hotel->reservationIndex.size() + acceptedCount);
+    for (int first = 0, batch = 0; first < acceptedCount; first += IMPORT_BATCH, batch++) {
+        if (first > 0) {
+            lock.unlock(); // Let waiting lookups and bookings in
+            lock.lock();
+        }
+        int count = min(IMPORT_BATCH, acceptedCount - first);
+        int nextCount = min(IMPORT_BATCH, acceptedCount - first - count);
+        const int* ids = batchIds[batch % 2].data();
+        runInParallel(nextCount > 0 ? 2 : 1, [&](int k) {
+            if (k == 1) {
+                generateReservationIds(nextCount, batchIds[(batch + 1) % 2].data());
+                return;
+            }
+            for (int r = 0; r < count; r++) {
+                const ImportRecord& record = *accepted[first + r];
+                storeReservation(record.roomNumber - 1, ids[r], record.guestName, record.arrivalDay,
+                                 record.nights, record.discountPercent, record.hasBreakfast);
+            }
+        });
+        report.imported += count;
+    }
+    lock.unlock();
+    
+    munmap(mapping, fileSize);
+    return true;
+}
+
+/**
+ * Parses and checks the records of one chunk of a feed
+ * @param text Whole lines of the feed
+ * @param format REPORT_CSV or REPORT_JSON
+ * @param columns CSV column of each ImportField (-1 = not in the feed)
+ * @param records Receives a record per line that is not blank (or a JSON
+ *                array bracket), numbered from the start of the chunk
+ * @return Number of lines in the chunk
+ */
+int parseImportChunk(string_view text, int format, const int columns[], vector<ImportRecord>& records)
+{
+    vector<string> cells;           // CSV cells, reused between lines
+    int cellCount = 0;
+    string values[IMPORT_FIELDS];   // JSON values, reused between lines
+    bool present[IMPORT_FIELDS];
+    const string* fields[IMPORT_FIELDS];
+    
+    int line = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = min(text.find('\n', pos), text.size());
+        string_view row = text.substr(pos, end - pos);
+        pos = end + 1;
+        line++;
+        
+        if (!row.empty() && row.back() == '\r') row.remove_suffix(1);
+        size_t first = row.find_first_not_of(" \t");
+        if (first == string_view::npos ||
+            (format == REPORT_JSON && (row[first] == '[' || row[first] == ']'))) {
+            continue;
+        }
+        
+        records.emplace_back();
+        ImportRecord& record = records.back();
+        record.line = line;
+        bool parsed;
+        if (format == REPORT_CSV) {
+            parsed = splitCsvLine(row, cells, cellCount);
+            for (int f = 0; f < IMPORT_FIELDS; f++) {
+                fields[f] = (columns[f] != -1 && columns[f] < cellCount) ? &cells[columns[f]] : nullptr;
+            }
+        } else {
+            parsed = splitJsonLine(row, values, present);
+            for (int f = 0; f < IMPORT_FIELDS; f++) {
+                fields[f] = present[f] ? &values[f] : nullptr;
+            }
+        }
+        record.error = parsed ? readImportRecord(fields, record) : "malformed line";
+    }
+    return line;
+}
+
+/**
+ * Splits a CSV line into cells ("" inside a quoted cell is one quote)
+ * @param line Line without its newline
+ * @param cells Cell buffers, reused between lines and grown as needed
+ * @param cellCount Receives the number of cells
+ * @return False if a quoted cell is not closed properly
+ */
+bool splitCsvLine(string_view line, vector<string>& cells, int& cellCount)
+{
+    cellCount = 0;
+    size_t pos = 0;
+    while (true) {
+        if (cellCount == static_cast<int>(cells.size())) {
+            cells.emplace_back();
+        }
+        string& cell = cells[cellCount++];
+        cell.clear();
+        
+        if (pos < line.size() && line[pos] == '"') {
+            pos++;
+            while (true) {
+                size_t quote = line.find('"', pos);
+                if (quote == string_view::npos) {
+                    return false;
+                }
+                cell.append(line.substr(pos, quote - pos));
+                pos = quote + 1;
+                if (pos >= line.size() || line[pos] != '"') break;
+                cell += '"';
+                pos++;
+            }
+            if (pos < line.size() && line[pos] != ',') {
+                return false;
+            }
+        } else {
+            size_t comma = min(line.find(',', pos), line.size());
+            cell.append(line.substr(pos, comma - pos));
+            pos = comma;
+        }
+        
+        if (pos >= line.size()) {
+            return true;
+        }
+        pos++; // Skip the comma
+    }
+}
+
+/**
+ * Reads the fields of a flat JSON object written on one line (a trailing
+ * comma, as between array elements, is allowed). Unknown keys and null
+ * values are skipped.
+ * @param line Line without its newline
+ * @param values Receives the value of each ImportField (strings unescaped,
+ *               numbers and true/false as written)
+ * @param present Receives whether each field was given
+ * @return False if the line is not such an object
+ */
+bool splitJsonLine(string_view line, string values[], bool present[])
+{
+    fill(present, present + IMPORT_FIELDS, false);
+    auto skipSpace = [line](size_t pos) {
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) pos++;
+        return pos;
+    };
+    
+    size_t pos = skipSpace(0);
+    if (pos >= line.size() || line[pos] != '{') {
+        return false;
+    }
+    pos = skipSpace(pos + 1);
+    string key;
+    while (pos < line.size() && line[pos] != '}') {
+        pos = readJsonString(line, pos, key);
+        if (pos == string_view::npos) return false;
+        pos = skipSpace(pos);
+        if (pos >= line.size() || line[pos] != ':') return false;
+        pos = skipSpace(pos + 1);
+        
+        int field = -1;
+        for (int f = 0; f < IMPORT_FIELDS; f++) {
+            if (key == IMPORT_FIELD_NAMES[f]) field = f;
+        }
+        string& value = (field != -1) ? values[field] : key; // Unknown values overwrite the key
+        bool given = true;
+        if (pos < line.size() && line[pos] == '"') {
+            pos = readJsonString(line, pos, value);
+            if (pos == string_view::npos) return false;
+        } else {
+            size_t end = min(line.find_first_of(",} \t", pos), line.size());
+            if (end == pos) return false;
+            value.assign(line.substr(pos, end - pos));
+            given = (value != "null");
+            pos = end;
+        }
+        if (field != -1) {
+            present[field] = given;
+        }
+        
+        pos = skipSpace(pos);
+        if (pos < line.size() && line[pos] == ',') {
+            pos = skipSpace(pos + 1);
+        } else if (pos >= line.size() || line[pos] != '}') {
+            return false;
+        }
+    }
+    if (pos >= line.size()) {
+        return false;
+    }
+    
+    pos = skipSpace(pos + 1);
+    if (pos < line.size() && line[pos] == ',') {
+        pos = skipSpace(pos + 1);
+    }
+    return pos == line.size();
+}
+
+/**
+ * Reads a JSON string literal (\u escapes become UTF-8)
+ * @param line Text holding the literal
+ * @param pos Position of its opening quote
+ * @param value Receives the unescaped string
+ * @return Position after the closing quote, or string_view::npos if malformed
+ */
+size_t readJsonString(string_view line, size_t pos, string& value)
+{
+    value.clear();
+    if (pos >= line.size() || line[pos] != '"') {
+        return string_view::npos;
+    }
+    pos++;
+    while (pos < line.size()) {
+        char c = line[pos++];
+        if (c == '"') {
+            return pos;
+        }
+        if (c != '\\') {
+            value += c;
+            continue;
+        }
+        if (pos >= line.size()) {
+            break;
+        }
+        char escaped = line[pos++];
+        switch (escaped) {
+            case '"': case '\\': case '/': value += escaped; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u': {
+                unsigned int code = 0;
+                if (pos + 4 > line.size() ||
+                    from_chars(line.data() + pos, line.data() + pos + 4, code, 16).ptr != line.data() + pos + 4) {
+                    return string_view::npos;
+                }
+                pos += 4;
+                if (code < 0x80) {
+                    value += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    value += static_cast<char>(0xc0 | (code >> 6));
+                    value += static_cast<char>(0x80 | (code & 0x3f));
+                } else {
+                    value += static_cast<char>(0xe0 | (code >> 12));
+                    value += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                    value += static_cast<char>(0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default:
+                return string_view::npos;
+        }
+    }
+    return string_view::npos;
+}
+
+/**
+ * Checks the fields of one feed record against the hotel, by the same
+ * rules as a batch booking
+ * @param values Value of each ImportField (nullptr = not given)
+ * @param record Receives the stay
+ * @return Why the record is refused, or nullptr if it can be booked
+ */
+const char* readImportRecord(const string* const values[], ImportRecord& record)
+{
+    if (!values[IMPORT_TYPE] || !values[IMPORT_GUEST] || !values[IMPORT_ARRIVAL] || !values[IMPORT_NIGHTS]) {
+        return "missing field";
+    }
+    
+    record.roomType = roomTypeNamed(*values[IMPORT_TYPE]);
+    if (record.roomType == -1) {
+        return "unknown room type";
+    }
+    
+    const string* room = values[IMPORT_ROOM];
+    record.roomNumber = 0;
+    if (room != nullptr && !room->empty() && *room != "any") {
+        if (!parseImportNumber(*room, record.roomNumber) ||
+            record.roomNumber < 1 || record.roomNumber > hotel->totalRooms) {
+            return "bad room number";
+        }
+        if (roomTypeOf(record.roomNumber - 1) != record.roomType) {
+            return "room is not of that type";
+        }
+    }
+    
+    if (!parseImportNumber(*values[IMPORT_ARRIVAL], record.arrivalDay) ||
+        !parseImportNumber(*values[IMPORT_NIGHTS], record.nights) ||
+        !isValidStay(record.arrivalDay, record.nights)) {
+        return "stay outside the booking horizon";
+    }
+    
+    const string* breakfast = values[IMPORT_BREAKFAST];
+    if (breakfast == nullptr || breakfast->empty() || *breakfast == "no" || *breakfast == "false") {
+        record.hasBreakfast = false;
+    } else if (*breakfast == "yes" || *breakfast == "true") {
+        record.hasBreakfast = true;
+    } else {
+        return "bad breakfast";
+    }
+    
+    const string* discount = values[IMPORT_DISCOUNT];
+    record.discountPercent = 0;
+    if (discount != nullptr && !discount->empty() &&
+        (!parseImportNumber(*discount, record.discountPercent) ||
+         record.discountPercent < 0 || record.discountPercent > 100)) {
+        return "bad discount";
+    }
+    
+    // Names are entered one per line, so they never hold control characters
+    const string& guestName = *values[IMPORT_GUEST];
+    if (guestName.empty()) {
+        return "missing guest name";
+    }
+    for (char c : guestName) {
+        if (static_cast<unsigned char>(c) < 0x20) {
+            return "bad guest name";
+        }
+    }
+    record.guestName = guestName;
+    return nullptr;
+}
+
+/**
+ * Parses a whole field as a decimal integer
+ * @param text Field
+ * @param value Receives the number
+ * @return False if the field is not just a number
+ */
+bool parseImportNumber(string_view text, int& value)
+{
+    const char* end = text.data() + text.size();
+    auto result = from_chars(text.data(), end, value);
+    return result.ec == errc() && result.ptr == end;
+}
+
+/**
+ * Picks a random free room of a type and takes the nights of a stay
+ * A few random rooms are tried first, which is enough unless the type is
+ * nearly full; only then is the type's free-room mask built.
+ * @param roomType Index into ROOM_TYPES
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return Room number, or -1 if no room of that type is free
+ */
+int claimRandomRoom(int roomType, int arrivalDay, int nights)
+{
+    int count = roomCountOfType(roomType);
+    if (count == 0) {
+        return -1;
+    }
+    for (int probe = 0; probe < ASSIGN_ROOM_PROBES; probe++) {
+        int i = hotel->firstRoomOfType[roomType] + randomBelow(count);
+        if (isRoomFreeFor(i, arrivalDay, nights) && claimRoomNights(i, arrivalDay, nights)) {
+            return roomNumberOf(i);
+        }
+    }
+    
+    while (true) {
+        int roomNumber = assignRandomRoom(roomType, arrivalDay, nights);
+        if (roomNumber == -1 || claimRoomNights(roomNumber - 1, arrivalDay, nights)) {
+            return roomNumber;
+        }
+        // Another thread took the room first: pick again
+    }
+}
+
+#ifdef __linux__
+
+// Stops the server loop; epoll_wait returns with EINTR
+void handleStopSignal(int)
+{
+    stopServer = 1;
+}
+
+/**
+ * Serves batch commands to many clients from one epoll event loop
+ * Replies for all requests that arrived in one wakeup are held back
+ * until their journal records are on disk (one fsync for the group).
+ * @param address TCP port on 127.0.0.1, or a Unix socket path (contains '/')
+ * @return Exit status
+ */
+int runServer(const string& address)
+{
+    int listener = openListener(address);
+    if (listener == -1) {
+        return 1;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal; // No SA_RESTART: interrupt epoll_wait
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listener, &event);
+    
+    unordered_map<int, Connection> connections; // Client fd -> connection
+    vector<int> replied;                        // Connections with new replies
+    ostringstream reply;                        // Reused output buffer
+    epoll_event events[MAX_EVENTS];
+    
+    cerr << "Serving on " << address << "\n";
+    while (!stopServer) {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            cerr << "Error: epoll_wait failed\n";
+            break;
+        }
+        
+        replied.clear();
+        for (int k = 0; k < ready; k++) {
+            int fd = events[k].data.fd;
+            
+            if (fd == listener) {
+                // Accept every pending client
+                int client;
+                while ((client = accept4(listener, nullptr, nullptr,
+                                         SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                    int on = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Fails harmlessly on Unix sockets
+                    event.events = EPOLLIN;
+                    event.data.fd = client;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &event);
+                    connections[client].fd = client;
+                }
+                continue;
+            }
+            
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue; // Closed earlier in this wakeup
+            }
+            Connection& connection = it->second;
+            bool closed = (events[k].events & (EPOLLERR | EPOLLHUP)) != 0;
+            
+            if (events[k].events & EPOLLIN) {
+                // Read everything available, then run the complete lines
+                char buffer[16384];
+                ssize_t got;
+                while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+                    connection.input.append(buffer, got);
+                }
+                if (got == 0) {
+                    // Client shut down its side: run what it sent (a last
+                    // line may lack its newline), answer, then close
+                    connection.inputClosed = true;
+                    if (!connection.input.empty()) {
+                        connection.input += '\n';
+                    }
+                } else if (got == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    closed = true;
+                }
+                size_t before = connection.output.size();
+                serveRequests(connection, reply);
+                if (connection.input.size() > MAX_REQUEST_BYTES) {
+                    closed = true;
+                }
+                if (connection.output.size() != before || connection.inputClosed) {
+                    replied.push_back(fd);
+                }
+            }
+            if ((events[k].events & EPOLLOUT) && !closed) {
+                closed = !sendReplies(connection);
+                replied.push_back(fd); // Drop EPOLLOUT once drained
+            }
+            
+            if (closed) {
+                close(fd); // Also removes it from the epoll set
+                connections.erase(it);
+            }
+        }
+        
+        // Make this round's bookings durable, then answer
+        syncJournal();
+        for (int fd : replied) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;
+            }
+            Connection& connection = it->second;
+            if (!sendReplies(connection)) {
+                close(fd);
+                connections.erase(it);
+                continue;
+            }
+            
+            // Wait for EPOLLOUT only while replies are backed up
+            bool wantsWrite = connection.outputSent < connection.output.size();
+            if (connection.inputClosed && !wantsWrite) {
+                close(fd); // Every reply sent to a client that is done sending
+                connections.erase(it);
+                continue;
+            }
+            if (wantsWrite != connection.wantsWrite || connection.inputClosed) {
+                // A shut-down client stays readable forever: stop watching input
+                connection.wantsWrite = wantsWrite;
+                event.events = connection.inputClosed ? 0u : uint32_t(EPOLLIN);
+                if (wantsWrite) {
+                    event.events |= EPOLLOUT;
+                }
+                event.data.fd = fd;
+                epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+            }
+        }
+    }
+    
+    for (auto& entry : connections) {
+        close(entry.first);
+    }
+    close(epollFd);
+    close(listener);
+    if (address.find('/') != string::npos) {
+        unlink(address.c_str());
+    }
+    return 0;
+}
+
+/**
+ * Opens a non-blocking listening socket
+ * @param address TCP port on 127.0.0.1, or a Unix socket path (contains '/')
+ * @return Socket, or -1 on error (reported on cerr)
+ */
+int openListener(const string& address)
+{
+    int fd;
+    if (address.find('/') != string::npos) {
+        sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(local.sun_path)) {
+            cerr << "Error: socket path too long: " << address << "\n";
+            return -1;
+        }
+        strcpy(local.sun_path, address.c_str());
+        unlink(address.c_str()); // Left over from an earlier run
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd != -1 && bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        int port = atoi(address.c_str());
+        if (port < 1 || port > 65535) {
+            cerr << "Error: invalid port: " << address << "\n";
+            return -1;
+        }
+        sockaddr_in loopback;
+        memset(&loopback, 0, sizeof(loopback));
+        loopback.sin_family = AF_INET;
+        loopback.sin_port = htons(static_cast<uint16_t>(port));
+        loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1;
+        if (fd != -1) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, reinterpret_cast<sockaddr*>(&loopback), sizeof(loopback)) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+    
+    if (fd == -1 || listen(fd, SOMAXCONN) != 0) {
+        cerr << "Error: cannot listen on " << address << ": " << strerror(errno) << "\n";
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Runs every complete request line a client has sent and queues the replies
+ * @param connection Client
+ * @param reply Scratch stream for command output
+ */
+void serveRequests(Connection& connection, ostringstream& reply)
+{
+    size_t start = 0, end;
+    while ((end = connection.input.find('\n', start)) != string::npos) {
+        string line = connection.input.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        start = end + 1;
+        
+        reply.str("");
+        string refused = fileCommandOf(line);
+        if (refused.empty()) {
+            executeRequest(line, reply);
+        } else {
+            reply << "ERROR " << refused << " is not available over the server (use --batch)\n";
+        }
+        string text = reply.str();
+        connection.output += to_string(text.size());
+        connection.output += '\n';
+        connection.output += text;
+    }
+    connection.input.erase(0, start);
+}
+
+/**
+ * Finds requests that read or write files named by the client
+ * Any client of the socket could otherwise read or overwrite files the
+ * server process can reach (and a large import would hold up the event
+ * loop for every other client), so serveRequests refuses them.
+ * @param line Request text (a chain request may start with 'at <property>')
+ * @return The command's name if it names files, "" otherwise
+ */
+string fileCommandOf(const string& line)
+{
+    istringstream args(line);
+    string command;
+    args >> command;
+    if (command == "at") {
+        int propertyId;
+        args >> propertyId >> command;
+    }
+    return (command == "export" || command == "import") ? command : "";
+}
+
+/**
+ * Sends as many queued replies as the socket accepts
+ * @param connection Client
+ * @return False if the connection failed
+ */
+bool sendReplies(Connection& connection)
+{
+    while (connection.outputSent < connection.output.size()) {
+        ssize_t sent = send(connection.fd, connection.output.data() + connection.outputSent,
+                            connection.output.size() - connection.outputSent, MSG_NOSIGNAL);
+        if (sent == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection.outputSent += sent;
+    }
+    connection.output.clear();
+    connection.outputSent = 0;
+    return true;
+}
+
+#else
+
+int runServer(const string& address)
+{
+    cerr << "Error: server mode (" << address << ") needs Linux (epoll)\n";
+    return 1;
+}
+
+#endif
+
+/**
+ * Runs the load generator against a fresh hotel and prints a latency
+ * report per operation type
+ * @param config Hotel size, operation count, mix and skew
+ * @return Exit status
+ */
+int runLoad(const LoadConfig& config)
+{
+    int totalWeight = 0;
+    for (int op = 0; op < LOAD_OPERATIONS; op++) {
+        totalWeight += config.mix[op];
+    }
+    if (totalWeight == 0) {
+        cerr << "Error: --mix gives every operation weight 0\n";
+        return 1;
+    }
+    
+    // Each type at the bottom of its price range
+    int roomCounts[ROOM_TYPE_COUNT];
+    int32_t priceCents[ROOM_TYPE_COUNT];
+    splitRooms(config.rooms, roomCounts);
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        priceCents[t] = ROOM_TYPES[t].minPriceEur * 100;
+    }
+    setupRooms(roomCounts, priceCents);
+    vector<double> nameRanks = zipfTable(config.guestNames, config.zipfSkew);
+    vector<double> recentRanks = zipfTable(1 << 16, config.zipfSkew); // Over the newest live bookings
+    
+    vector<int> live;                               // IDs of active reservations, oldest first
+    vector<uint32_t> latency[LOAD_OPERATIONS];      // Nanoseconds per operation
+    long succeeded[LOAD_OPERATIONS] = {0};          // Bookings made, reservations found, ...
+    ostringstream listing;                          // Sink for room listings
+    
+    auto started = chrono::steady_clock::now();
+    for (long n = 0; n < config.operations; n++) {
+        // Pick the operation by weight, and its arguments, before timing
+        int pick = randomBelow(totalWeight);
+        int op = 0;
+        while (pick >= config.mix[op]) {
+            pick -= config.mix[op++];
+        }
+        if ((op == LOAD_SEARCH_ID || op == LOAD_CANCEL) && live.empty()) {
+            op = LOAD_BOOK; // Nothing to look up yet
+        }
+        
+        int nights = 1 + randomBelow(7);
+        int arrivalDay = randomBelow(CALENDAR_DAYS - nights + 1);
+        int roomType = randomRoomType();
+        string guestName = "Guest " + to_string(zipfRank(nameRanks));
+        size_t recent = live.empty() ? 0
+                        : live.size() - 1 - zipfRank(recentRanks) % live.size();
+        listing.str("");
+        
+        auto opStart = chrono::steady_clock::now();
+        switch (op) {
+            case LOAD_BOOK: {
+                int reservationId = reserveRoom(roomType, 0, guestName, arrivalDay,
+                                                nights, randomBelow(2) == 0);
+                if (reservationId != -1) {
+                    live.push_back(reservationId);
+                    succeeded[op]++;
+                }
+                break;
+            }
+            case LOAD_SEARCH_ID: {
+                shared_lock<shared_mutex> lock(hotel->reservationLock);
+                int r = findReservationById(live[recent]);
+                succeeded[op] += (r != -1 && reservationTotal(r) > 0);
+                break;
+            }
+            case LOAD_SEARCH_NAME: {
+                shared_lock<shared_mutex> lock(hotel->reservationLock);
+                succeeded[op] += !findReservationsByName(guestName).empty();
+                break;
+            }
+            case LOAD_LIST:
+                displayAvailableRooms(listing, arrivalDay, nights);
+                succeeded[op]++;
+                break;
+            case LOAD_CANCEL:
+                if (cancelReservation(live[recent])) {
+                    succeeded[op]++;
+                }
+                live[recent] = live.back(); // Order is only used for recency skew
+                live.pop_back();
+                break;
+        }
+        auto opEnd = chrono::steady_clock::now();
+        latency[op].push_back(static_cast<uint32_t>(
+            min<int64_t>(chrono::duration_cast<chrono::nanoseconds>(opEnd - opStart).count(), UINT32_MAX)));
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    
+    // Report
+    cout << "Load: " << config.rooms << " rooms, " << config.operations << " operations, "
+         << config.guestNames << " guest names, zipf " << config.zipfSkew << "\n";
+    cout << left << setw(13) << "operation" << right << setw(10) << "count" << setw(10) << "ok"
+         << setw(11) << "ops/s" << setw(10) << "p50 us" << setw(10) << "p99 us"
+         << setw(10) << "p999 us" << "\n";
+    for (int op = 0; op < LOAD_OPERATIONS; op++) {
+        vector<uint32_t>& samples = latency[op];
+        if (samples.empty()) {
+            continue;
+        }
+        sort(samples.begin(), samples.end());
+        auto percentile = [&samples](double q) {
+            return samples[min(samples.size() - 1, size_t(q * samples.size()))] / 1000.0;
+        };
+        cout << left << setw(13) << LOAD_OPERATION_NAMES[op] << right
+             << setw(10) << samples.size() << setw(10) << succeeded[op]
+             << setw(11) << fixed << setprecision(0) << samples.size() / seconds
+             << setprecision(2) << setw(10) << percentile(0.50) << setw(10) << percentile(0.99)
+             << setw(10) << percentile(0.999) << "\n";
+    }
+    cout << "Total: " << setprecision(3) << seconds << " s, " << setprecision(0)
+         << config.operations / seconds << " ops/s, " << live.size() << " reservations live\n";
+    return 0;
+}
+
+/**
+ * Parses operation weights such as "book:40,search-id:25,cancel:10"
+ * Operations not listed get weight 0.
+ * @param text Comma-separated name:weight pairs
+ * @param config Receives the weights
+ * @return False if a name or weight is invalid
+ */
+bool parseLoadMix(const string& text, LoadConfig& config)
+{
+    int mix[LOAD_OPERATIONS] = {0};
+    istringstream items(text);
+    string item;
+    while (getline(items, item, ',')) {
+        size_t colon = item.find(':');
+        int op = 0;
+        while (op < LOAD_OPERATIONS && item.compare(0, colon, LOAD_OPERATION_NAMES[op]) != 0) {
+            op++;
+        }
+        if (colon == string::npos || op == LOAD_OPERATIONS) {
+            return false;
+        }
+        mix[op] = atoi(item.c_str() + colon + 1);
+        if (mix[op] < 0) {
+            return false;
+        }
+    }
+    copy(mix, mix + LOAD_OPERATIONS, config.mix);
+    return true;
+}
+
+/**
+ * Builds the cumulative distribution of a Zipf law over ranks 1..items
+ * @param items Number of ranks
+ * @param skew Exponent (0 = uniform)
+ * @return cumulative[k] = probability of a rank up to k + 1
+ */
+vector<double> zipfTable(int items, double skew)
+{
+    vector<double> cumulative(items);
+    double sum = 0.0;
+    for (int k = 0; k < items; k++) {
+        sum += 1.0 / pow(k + 1, skew);
+        cumulative[k] = sum;
+    }
+    for (double& value : cumulative) {
+        value /= sum;
+    }
+    return cumulative;
+}
+
+/**
+ * Draws a Zipf-distributed rank
+ * @param cumulative Table from zipfTable
+ * @return Rank, 0-based (0 is the most frequent)
+ */
+int zipfRank(const vector<double>& cumulative)
+{
+    auto it = upper_bound(cumulative.begin(), cumulative.end(), randomFraction());
+    return static_cast<int>(min(it - cumulative.begin(), ptrdiff_t(cumulative.size()) - 1));
+}
+
+OperationTimer::OperationTimer(int metricOperation)
+    : operation(metricOperation), startTicks(metricTicks())
+{
+}
+
+OperationTimer::~OperationTimer()
+{
+    recordLatency(operation, metricTicks() - startTicks);
+}
+
+/**
+ * Adds one completed operation to the calling thread's metrics
+ * @param operation MetricOperation
+ * @param ticks Latency in metricTicks units
+ */
+void recordLatency(int operation, uint64_t ticks)
+{
+    ThreadMetrics* metrics = threadMetrics;
+    if (metrics == nullptr) {
+        // First operation on this thread: register its metrics
+        metrics = threadMetrics = new ThreadMetrics();
+        lock_guard<mutex> lock(metricsLock);
+        metricsRegistry.push_back(metrics);
+    }
+    
+    // Single writer: plain increments published with relaxed stores
+    uint64_t& bucket = metrics->buckets[operation][metricBucket(ticks)];
+    __atomic_store_n(&bucket, bucket + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&metrics->totalTicks[operation], metrics->totalTicks[operation] + ticks, __ATOMIC_RELAXED);
+}
+
+/**
+ * Reads the timestamp used for operation latencies
+ * @return CPU timestamp counter on x86, steady clock nanoseconds elsewhere
+ */
+uint64_t metricTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * Length of a metricTicks unit, measured against the steady clock once
+ * (the first call takes about 20 ms)
+ * @return Nanoseconds per tick
+ */
+double metricNanosPerTick()
+{
+    static const double nanosPerTick = [] {
+        auto start = chrono::steady_clock::now();
+        uint64_t startTicks = metricTicks();
+        auto end = start;
+        while (end - start < chrono::milliseconds(20)) {
+            end = chrono::steady_clock::now();
+        }
+        uint64_t ticks = metricTicks() - startTicks;
+        return ticks == 0 ? 1.0 : chrono::duration<double, nano>(end - start).count() / ticks;
+    }();
+    return nanosPerTick;
+}
+
+/**
+ * Finds the histogram bucket of a latency
+ * @param ticks Latency in metricTicks units
+ * @return Bucket index: values below 16 map to themselves, larger ones
+ *         to (power of two, top 4 bits below the leading one)
+ */
+int metricBucket(uint64_t ticks)
+{
+    if (ticks < METRIC_SUB_BUCKETS) {
+        return static_cast<int>(ticks);
+    }
+    int msb = 63 - __builtin_clzll(ticks);
+    return (msb - 3) * METRIC_SUB_BUCKETS + static_cast<int>((ticks >> (msb - 4)) & 15);
+}
+
+/**
+ * Upper bound of a histogram bucket
+ * @param bucket Bucket index
+ * @return Smallest latency (ticks) above the bucket
+ */
+uint64_t metricBucketLimit(int bucket)
+{
+    if (bucket < METRIC_SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    int shift = bucket / METRIC_SUB_BUCKETS - 1;
+    uint64_t low = uint64_t(METRIC_SUB_BUCKETS + bucket % METRIC_SUB_BUCKETS) << shift;
+    return low + (uint64_t(1) << shift);
+}
+
+/**
+ * Sums the metrics of every thread
+ * Counters are read while threads keep recording, and relaxed loads may
+ * see a bucket lag behind its call count, so the merged call count is
+ * taken as the sum of the merged buckets: percentiles and exported
+ * histograms then always agree with it.
+ * @param total Receives the merged counts (must start zeroed)
+ */
+void mergeMetrics(ThreadMetrics& total)
+{
+    lock_guard<mutex> lock(metricsLock);
+    for (ThreadMetrics* metrics : metricsRegistry) {
+        for (int op = 0; op < METRIC_OPERATIONS; op++) {
+            total.totalTicks[op] += __atomic_load_n(&metrics->totalTicks[op], __ATOMIC_RELAXED);
+            for (int b = 0; b < METRIC_BUCKETS; b++) {
+                uint64_t count = __atomic_load_n(&metrics->buckets[op][b], __ATOMIC_RELAXED);
+                total.buckets[op][b] += count;
+                total.calls[op] += count;
+            }
+        }
+    }
+}
+
+/**
+ * Prints call counts and latency percentiles of every operation
+ * @param out Stream receiving the table
+ */
+void showStatistics(ostream& out)
+{
+    auto total = make_unique<ThreadMetrics>(); // Too big for the stack
+    mergeMetrics(*total);
+    double microsPerTick = metricNanosPerTick() / 1000.0;
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    
+    out << "\n======== OPERATION STATISTICS ========\n";
+    out << left << setw(25) << "Operation" << right << setw(9) << "Calls" << setw(11) << "Mean us"
+        << setw(10) << "p50 us" << setw(10) << "p99 us" << setw(11) << "p999 us" << "\n";
+    for (int op = 0; op < METRIC_OPERATIONS; op++) {
+        uint64_t calls = total->calls[op];
+        out << left << setw(25) << METRIC_NAMES[op] << right << setw(9) << calls;
+        if (calls == 0) {
+            out << setw(11) << "-" << setw(10) << "-" << setw(10) << "-" << setw(11) << "-" << "\n";
+            continue;
+        }
+        
+        // Percentiles: upper bound of the bucket holding the ranked call
+        double percentile[3] = {0.50, 0.99, 0.999};
+        double limit[3];
+        for (int q = 0; q < 3; q++) {
+            uint64_t rank = static_cast<uint64_t>(percentile[q] * (calls - 1)), seen = 0;
+            int b = 0;
+            while ((seen += total->buckets[op][b]) <= rank && b < METRIC_BUCKETS - 1) {
+                b++;
+            }
+            limit[q] = metricBucketLimit(b) * microsPerTick;
+        }
+        out << fixed << setprecision(2) << setw(11) << total->totalTicks[op] * microsPerTick / calls
+            << setw(10) << limit[0] << setw(10) << limit[1] << setw(11) << limit[2] << "\n";
+    }
+    out << "======================================\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+/**
+ * Writes the metrics in Prometheus text exposition format
+ * Histogram buckets are coarsened to fixed bounds from 1 us to 10 s.
+ * @param out Stream receiving the metrics
+ */
+void writeStatsText(ostream& out)
+{
+    const double bounds[] = {1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+                             1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 2.5, 10.0};
+    auto total = make_unique<ThreadMetrics>();
+    mergeMetrics(*total);
+    double nanosPerTick = metricNanosPerTick();
+    
+    // The exposition never depends on what earlier output did to the stream
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out.flags(ios::dec); // Default float format, no showpos or showpoint
+    
+    out << "# HELP hotel_operation_latency_seconds Latency of hotel operations by entry point.\n";
+    out << "# TYPE hotel_operation_latency_seconds histogram\n";
+    for (int op = 0; op < METRIC_OPERATIONS; op++) {
+        // A fine bucket counts toward a bound once it lies entirely below it
+        int b = 0;
+        uint64_t cumulative = 0;
+        for (double bound : bounds) {
+            while (b < METRIC_BUCKETS && metricBucketLimit(b) * nanosPerTick <= bound * 1e9) {
+                cumulative += total->buckets[op][b++];
+            }
+            out << "hotel_operation_latency_seconds_bucket{operation=\"" << METRIC_NAMES[op]
+                << "\",le=\"" << setprecision(6) << bound << "\"} " << cumulative << "\n";
+        }
+        out << "hotel_operation_latency_seconds_bucket{operation=\"" << METRIC_NAMES[op]
+            << "\",le=\"+Inf\"} " << total->calls[op] << "\n";
+        out << "hotel_operation_latency_seconds_sum{operation=\"" << METRIC_NAMES[op] << "\"} "
+            << setprecision(9) << total->totalTicks[op] * nanosPerTick / 1e9 << "\n";
+        out << "hotel_operation_latency_seconds_count{operation=\"" << METRIC_NAMES[op] << "\"} "
+            << total->calls[op] << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+/**
+ * Starts a thread that rewrites the metrics file periodically
+ * @param path Output file, or empty for no dumps
+ * @param intervalSeconds Time between dumps
+ */
+void startStatsDump(const string& path, int intervalSeconds)
+{
+    if (path.empty()) {
+        return;
+    }
+    statsDump.path = path;
+    statsDump.intervalSeconds = intervalSeconds;
+    statsDump.writer = thread([] {
+        unique_lock<mutex> lock(statsDump.lock);
+        while (!statsDump.wake.wait_for(lock, chrono::seconds(statsDump.intervalSeconds),
+                                        [] { return statsDump.stopping; })) {
+            writeStatsFile();
+        }
+    });
+}
+
+/**
+ * Stops the dump thread and writes the final metrics file
+ */
+void stopStatsDump()
+{
+    if (!statsDump.writer.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(statsDump.lock);
+        statsDump.stopping = true;
+    }
+    statsDump.wake.notify_one();
+    statsDump.writer.join();
+    writeStatsFile();
+}
+
+/**
+ * Replaces the metrics file (written aside, then renamed, so scrapers
+ * never see a partial file)
+ * @return False if the file could not be written
+ */
+bool writeStatsFile()
+{
+    string tempPath = statsDump.path + ".tmp";
+    {
+        ofstream file(tempPath);
+        writeStatsText(file);
+        if (!file) {
+            cerr << "Warning: cannot write " << tempPath << "\n";
+            return false;
+        }
+    }
+    return rename(tempPath.c_str(), statsDump.path.c_str()) == 0;
+}
+
+/**
+ * Executes one batch or server request against the hotel or the chain
+ * @param line Command text
+ * @param out Stream receiving the result
+ * @return False if the command could not be parsed
+ */
+bool executeRequest(const string& line, ostream& out)
+{
+    return chain.properties.empty() ? executeCommand(line, out)
+                                    : executeChainCommand(line, out);
+}
+
+/**
+ * Starts the single hotel, or the whole chain in chain mode
+ * @param dataDir Data directory, or empty to run without persistence
+ * @param chainSize Number of chain properties (0 = single hotel)
+ * @param workerCount Chain worker threads
+ * @return False if a data directory could not be used
+ */
+bool startHotels(const string& dataDir, int chainSize, int workerCount)
+{
+    return chainSize > 0 ? startChain(chainSize, workerCount, dataDir)
+                         : startHotel(dataDir);
+}
+
+/**
+ * Flushes and closes whatever startHotels started, and writes the
+ * final metrics dump
+ */
+void stopHotels()
+{
+    stopStatsDump();
+    if (chain.properties.empty()) {
+        closeJournal();
+    } else {
+        stopChain();
+    }
+}
+
+/**
+ * Creates the chain's properties and their worker threads
+ * Property IDs run from 1; cities are assigned round-robin. Each
+ * property keeps its journal and snapshot in DIR/property-<ID>.
+ * @param propertyCount Number of properties
+ * @param workerCount Worker threads (capped at the property count)
+ * @param dataDir Data directory, or empty to run without persistence
+ * @return False if a property could not be started
+ */
+bool startChain(int propertyCount, int workerCount, const string& dataDir)
+{
+    for (int id = 1; id <= propertyCount; id++) {
+        chain.properties.push_back(make_unique<Hotel>());
+        chain.properties.back()->propertyId = id;
+        chain.properties.back()->city = CHAIN_CITIES[(id - 1) % CHAIN_CITY_COUNT];
+    }
+    for (int k = 0; k < min(workerCount, propertyCount); k++) {
+        chain.workers.push_back(make_unique<ChainWorker>());
+        chain.workers.back()->worker = thread(runChainWorker, ref(*chain.workers.back()), k);
+    }
+    
+    // Each property is built (or recovered) by its own worker, in parallel
+    vector<future<bool>> started;
+    for (int id = 1; id <= propertyCount; id++) {
+        string propertyDir;
+        if (!dataDir.empty()) {
+            propertyDir = dataDir + "/property-" + to_string(id);
+            mkdir(propertyDir.c_str(), 0755); // Fails harmlessly if it exists
+        }
+        started.push_back(onProperty<bool>(id, [propertyDir] { return startHotel(propertyDir); }));
+    }
+    bool ok = true;
+    for (future<bool>& result : started) {
+        ok = result.get() && ok;
+    }
+    if (!ok) {
+        stopChain();
+    }
+    return ok;
+}
+
+/**
+ * Worker thread: runs queued property work until the chain stops
+ * Tasks are taken in batches; the journals they touched are synced
+ * once per batch before any result is handed back.
+ * @param worker This worker
+ * @param index Worker number (selects a fixed random stream)
+ */
+void runChainWorker(ChainWorker& worker, unsigned int index)
+{
+    seedThreadRandom(CHAIN_RANDOM_STREAM + index);
+    vector<ChainTask> batch;
+    while (true) {
+        {
+            unique_lock<mutex> lock(worker.queueLock);
+            worker.wake.wait(lock, [&worker] { return worker.stopping || !worker.tasks.empty(); });
+            if (worker.tasks.empty()) {
+                return; // Stopping and drained
+            }
+            batch.swap(worker.tasks);
+        }
+        
+        for (ChainTask& task : batch) {
+            hotel = task.property;
+            task.run();
+        }
+        for (ChainTask& task : batch) {
+            hotel = task.property;
+            syncJournal(); // No-op once this property is synced
+        }
+        for (ChainTask& task : batch) {
+            task.finish();
+        }
+        batch.clear();
+    }
+}
+
+/**
+ * Closes every property's journal and stops the worker threads
+ */
+void stopChain()
+{
+    vector<future<bool>> closed;
+    for (size_t id = 1; id <= chain.properties.size(); id++) {
+        closed.push_back(onProperty<bool>(id, [] { closeJournal(); return true; }));
+    }
+    for (future<bool>& result : closed) {
+        result.wait();
+    }
+    
+    for (auto& worker : chain.workers) {
+        {
+            lock_guard<mutex> lock(worker->queueLock);
+            worker->stopping = true;
+        }
+        worker->wake.notify_one();
+        worker->worker.join();
+    }
+    chain.workers.clear();
+    chain.properties.clear();
+}
+
+/**
+ * Executes one chain-mode command and writes its result
+ * Commands:
+ *   properties
+ *   stats
+ *   at <property id> <command>       (any single-hotel command)
+ *   city-available <city> <room type> <arrival day> <nights>
+ *   book-city <city> <room type> <arrival day> <nights> <breakfast yes|no> <guest name>
+ * @param line Command text
+ * @param out Stream receiving the result
+ * @return False if the command could not be parsed
+ */
+bool executeChainCommand(const string& line, ostream& out)
+{
+    istringstream args(line);
+    string command;
+    if (!(args >> command) || command[0] == '#') {
+        return true; // Blank line or comment
+    }
+    int propertyCount = static_cast<int>(chain.properties.size());
+    
+    if (command == "stats") {
+        writeStatsText(out); // Metrics cover the whole process
+    } else if (command == "properties") {
+        for (auto& property : chain.properties) {
+            // Layout is fixed once started, so reading it here is safe
+            out << "PROPERTY " << property->propertyId << " " << property->city << " rooms";
+            for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+                out << " " << property->firstRoomOfType[t+1] - property->firstRoomOfType[t]
+                    << " " << ROOM_TYPES[t].name;
+            }
+            out << "\n";
+        }
+    } else if (command == "at") {
+        int propertyId = 0;
+        string request;
+        args >> propertyId;
+        getline(args >> ws, request);
+        if (propertyId < 1 || propertyId > propertyCount || request.empty()) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        auto reply = onProperty<pair<bool, string>>(propertyId, [request] {
+            ostringstream text;
+            bool parsed = executeCommand(request, text);
+            return make_pair(parsed, text.str());
+        }).get();
+        out << reply.second;
+        return reply.first;
+    } else if (command == "city-available" || command == "book-city") {
+        string city, type, breakfast, guestName;
+        int arrivalDay = -1, nights = 0;
+        args >> city >> type >> arrivalDay >> nights;
+        if (command == "book-city") {
+            args >> breakfast;
+            getline(args >> ws, guestName);
+        }
+        int roomType = roomTypeNamed(type);
+        bool validBooking = command == "city-available" ||
+                            ((breakfast == "yes" || breakfast == "no") && !guestName.empty());
+        if (roomType == -1 || !validBooking || !isValidStay(arrivalDay, nights)) {
+            out << "ERROR bad arguments: " << line << "\n";
+            return false;
+        }
+        
+        vector<pair<int, int>> candidates = freeRoomsInCity(foldName(city), roomType,
+                                                            arrivalDay, nights);
+        if (command == "city-available") {
+            int total = 0;
+            for (const auto& candidate : candidates) {
+                total += candidate.second;
+            }
+            out << "AVAILABLE " << total << " in " << candidates.size() << " properties\n";
+            for (const auto& candidate : candidates) {
+                out << "  property " << candidate.first << " free " << candidate.second << "\n";
+            }
+            return true;
+        }
+        
+        // Try the emptiest property first; move on if it filled up meanwhile
+        string request = "book " + type + " any " + to_string(arrivalDay) + " " +
+                         to_string(nights) + " " + breakfast + " " + guestName;
+        for (const auto& candidate : candidates) {
+            string reply = onProperty<string>(candidate.first, [request] {
+                ostringstream text;
+                executeCommand(request, text);
+                return text.str();
+            }).get();
+            if (reply.compare(0, 7, "BOOKED ") == 0) {
+                out << "PROPERTY " << candidate.first << " " << reply;
+                return true;
+            }
+        }
+        out << "FAILED book-city " << city << " " << type << "\n";
+    } else {
+        out << "ERROR unknown command: " << command << " (use: at <property> " << command << " ...)\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Counts free rooms of a type in every property of a city, in parallel
+ * @param city Folded city name
+ * @param roomType Index into ROOM_TYPES
+ * @param arrivalDay First night (0 = tonight)
+ * @param nights Number of nights
+ * @return (property ID, free rooms) for properties with a free room,
+ *         most free rooms first
+ */
+vector<pair<int, int>> freeRoomsInCity(const string& city, int roomType,
+                                       int arrivalDay, int nights)
+{
+    vector<pair<int, future<int>>> counts;
+    for (auto& property : chain.properties) {
+        if (property->city == city) {
+            counts.emplace_back(property->propertyId, onProperty<int>(property->propertyId, [=] {
+                vector<uint64_t> mask;
+                freeRoomsMask(roomType, arrivalDay, nights, mask);
+                return countSetBits(mask);
+            }));
+        }
+    }
+    
+    // Merge the answers
+    vector<pair<int, int>> candidates;
+    for (auto& count : counts) {
+        int freeRooms = count.second.get();
+        if (freeRooms > 0) {
+            candidates.emplace_back(count.first, freeRooms);
+        }
+    }
+    sort(candidates.begin(), candidates.end(), [](const pair<int, int>& a, const pair<int, int>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return candidates;
+}
+
+/**
+ * Sets up the hotel: recovers it from a data directory if one is given
+ * and holds saved state, otherwise builds a random one
+ * @param dataDir Data directory, or empty to run without persistence
+ * @return False if the data directory could not be used
+ */
+bool startHotel(const string& dataDir)
+{
+    bool recovered = !dataDir.empty() && recoverState(dataDir);
+    if (!recovered) {
+        initializeRooms();
+    }
+    
+    if (!dataDir.empty() && !openJournal(dataDir, !recovered)) {
+        cerr << "Error: cannot open journal in " << dataDir << "\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Restores the hotel from the latest snapshot plus the journal
+ * Replay stops at the first torn or corrupt record; the journal is cut
+ * back to that point when it is reopened.
+ * @param dataDir Data directory
+ * @return True if a saved hotel was found and restored
+ */
+bool recoverState(const string& dataDir)
+{
+    string journalData;
+    bool haveJournal = readWholeFile(dataDir + "/hotel.journal", journalData);
+    
+    hotel->journal.replaying = true;
+    hotel->totalRooms = 0; // Set by the snapshot or the layout record
+    uint64_t snapshotLsn = 0;
+    
+    string snapshotPath = dataDir + "/hotel.snapshot";
+    if (access(snapshotPath.c_str(), F_OK) == 0) {
+        if (!loadSnapshot(snapshotPath, snapshotLsn)) {
+            // Snapshots are renamed into place only once fully written
+            cerr << "Error: " << snapshotPath << " is damaged or from another version\n";
+            exit(1);
+        }
+        hotel->journal.nextLsn = snapshotLsn + 1;
+    } else if (!haveJournal) {
+        hotel->journal.replaying = false;
+        return false;
+    }
+    
+    size_t validBytes = replayRecords(journalData, snapshotLsn);
+    hotel->journal.replaying = false;
+    
+    if (hotel->totalRooms == 0) {
+        return false; // Nothing usable (e.g. crash before the layout was synced)
+    }
+    
+    rebuildIdAllocator();
+    hotel->journal.pending.clear();
+    
+    // Drop a torn tail so new records follow the last good one
+    if (validBytes < journalData.size()) {
+        if (truncate((dataDir + "/hotel.journal").c_str(), static_cast<off_t>(validBytes)) != 0) {
+            cerr << "Warning: could not truncate torn journal tail\n";
+        }
+    }
+    
+    *promptOut << "Recovered " << hotel->reservationIndex.size() << " reservations ("
+               << hotel->totalRooms << " rooms) from " << dataDir << "\n\n";
+    return true;
+}
+
+/**
+ * Applies every valid record of a journal image
+ * Each record is: payload length (u32), checksum (u32), payload.
+ * @param data File contents
+ * @param afterLsn Records with an LSN at or below this are skipped
+ * @return Number of bytes holding valid records
+ */
+size_t replayRecords(const string& data, uint64_t afterLsn)
+{
+    size_t pos = 0;
+    while (pos + 8 <= data.size()) {
+        const char* header = data.data() + pos;
+        uint32_t length = getValue<uint32_t>(header);
+        uint32_t sum = getValue<uint32_t>(header);
+        if (length < 9 || pos + 8 + length > data.size() ||
+            checksum(header, length) != sum) {
+            break; // Torn or corrupt record
+        }
+        if (!applyJournalRecord(header, length, afterLsn)) {
+            break;
+        }
+        pos += 8 + length;
+    }
+    return pos;
+}
+
+/**
+ * Applies one journal record to the in-memory hotel
+ * @param payload Record payload (LSN, kind, fields)
+ * @param length Payload length in bytes
+ * @param afterLsn Records with an LSN at or below this are skipped
+ * @return False if the record is malformed
+ */
+bool applyJournalRecord(const char* payload, size_t length, uint64_t afterLsn)
+{
+    const char* pos = payload;
+    const char* end = payload + length;
+    uint64_t lsn = getValue<uint64_t>(pos);
+    uint8_t kind = getValue<uint8_t>(pos);
+    hotel->journal.nextLsn = max(hotel->journal.nextLsn, lsn + 1);
+    
+    if (lsn <= afterLsn) {
+        return true; // Already contained in the snapshot
+    }
+    
+    if (kind == JOURNAL_LAYOUT) {
+        if (end - pos < 24) return false;
+        int32_t roomCount = getValue<int32_t>(pos);
+        int32_t singleCount = getValue<int32_t>(pos);
+        double singlePrice = getValue<double>(pos);
+        double doublePrice = getValue<double>(pos);
+        if (singleCount < 0 || singleCount > roomCount) return false;
+        for (double price : {singlePrice, doublePrice}) {
+            if (!(price >= 0 && price * 100 <= MAX_BASE_PRICE_CENTS)) return false; // Also refuses NaN
+        }
+        int roomCounts[ROOM_TYPE_COUNT] = {0};
+        int32_t priceCents[ROOM_TYPE_COUNT] = {0};
+        roomCounts[SINGLE_ROOM] = singleCount;
+        roomCounts[DOUBLE_ROOM] = roomCount - singleCount;
+        priceCents[SINGLE_ROOM] = static_cast<int32_t>(llround(singlePrice * 100));
+        priceCents[DOUBLE_ROOM] = static_cast<int32_t>(llround(doublePrice * 100));
+        setupRooms(roomCounts, priceCents);
+        return true;
+    }
+    
+    if (kind == JOURNAL_ROOM_TYPES) {
+        if (end - pos < 4) return false;
+        int32_t typeCount = getValue<int32_t>(pos);
+        if (typeCount < 0 || typeCount > ROOM_TYPE_COUNT || end - pos < 8 * typeCount) {
+            return false; // Written by a release with more room types
+        }
+        int roomCounts[ROOM_TYPE_COUNT] = {0};
+        int32_t priceCents[ROOM_TYPE_COUNT] = {0};
+        for (int t = 0; t < typeCount; t++) {
+            roomCounts[t] = getValue<int32_t>(pos);
+            priceCents[t] = getValue<int32_t>(pos);
+            if (roomCounts[t] < 0 || priceCents[t] < 0 || priceCents[t] > MAX_BASE_PRICE_CENTS) {
+                return false;
+            }
+        }
+        setupRooms(roomCounts, priceCents);
+        return true;
+    }
+    
+    if (kind == JOURNAL_BOOK) {
+        if (end - pos < 21 || hotel->totalRooms == 0) return false;
+        int32_t reservationId = getValue<int32_t>(pos);
+        int32_t roomIndex = getValue<int32_t>(pos);
+        int16_t arrivalDay = getValue<int16_t>(pos);
+        uint8_t nights = getValue<uint8_t>(pos);
+        uint8_t status = getValue<uint8_t>(pos);
+        int discount = static_cast<int>(lround(getValue<double>(pos) * 100));
+        uint8_t nameLength = getValue<uint8_t>(pos);
+        if (end - pos < nameLength || roomIndex < 0 || roomIndex >= hotel->totalRooms ||
+            !isValidStay(arrivalDay, nights)) {
+            return false;
+        }
+        commitReservation(roomIndex + 1, reservationId, string(pos, nameLength),
+                          arrivalDay, nights, discount, (status & RES_BREAKFAST) != 0);
+        return true;
+    }
+    
+    if (kind == JOURNAL_CANCEL) {
+        if (end - pos < 4) return false;
+        cancelReservation(getValue<int32_t>(pos));
+        return true;
+    }
+    
+    if (kind == JOURNAL_MODIFY) {
+        if (end - pos < 11) return false;
+        int32_t reservationId = getValue<int32_t>(pos);
+        int32_t roomIndex = getValue<int32_t>(pos);
+        int16_t arrivalDay = getValue<int16_t>(pos);
+        uint8_t nights = getValue<uint8_t>(pos);
+        if (roomIndex < 0 || roomIndex >= hotel->totalRooms) return false;
+        modifyReservation(reservationId, roomIndex + 1, arrivalDay, nights);
+        return true;
+    }
+    
+    return false; // Unknown record kind
+}
+
+/**
+ * Opens the journal for appending
+ * @param dataDir Data directory
+ * @param freshHotel True if nothing was recovered; starts a new journal
+ *        whose first record is the hotel layout
+ * @return False on I/O error
+ */
+bool openJournal(const string& dataDir, bool freshHotel)
+{
+    string path = dataDir + "/hotel.journal";
+    int flags = O_WRONLY | O_CREAT | O_APPEND | (freshHotel ? O_TRUNC : 0);
+    hotel->journal.fd = open(path.c_str(), flags, 0644);
+    if (hotel->journal.fd == -1) {
+        return false;
+    }
+    hotel->journal.directory = dataDir;
+    
+    if (freshHotel) {
+        remove((dataDir + "/hotel.snapshot").c_str()); // Belongs to another hotel
+        hotel->journal.nextLsn = 1;
+        string payload;
+        encodeLayout(payload, hotel->journal.nextLsn);
+        logJournalRecord(payload);
+        syncJournal();
+    }
+    return true;
+}
+
+/**
+ * Encodes the hotel layout record: rooms and price of every room type
+ * @param out Receives the payload
+ * @param lsn Sequence number of the record
+ */
+void encodeLayout(string& out, uint64_t lsn)
+{
+    putValue(out, lsn);
+    putValue(out, JOURNAL_ROOM_TYPES);
+    putValue(out, int32_t(ROOM_TYPE_COUNT));
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        int firstRoom = hotel->firstRoomOfType[t];
+        putValue(out, int32_t(roomCountOfType(t)));
+        putValue(out, roomCountOfType(t) > 0 ? roomBasePrice(firstRoom) : int32_t(0));
+    }
+}
+
+/**
+ * Encodes a reservation as a booking record
+ * @param out Receives the payload
+ * @param lsn Sequence number of the record
+ * @param slot Slot in the reservation store
+ */
+void encodeBook(string& out, uint64_t lsn, int slot)
+{
+    string_view guestName = guestNameOf(slot);
+    size_t nameLength = min<size_t>(guestName.size(), 255);
+    
+    putValue(out, lsn);
+    putValue(out, JOURNAL_BOOK);
+    putValue(out, int32_t(reservationIdOf(slot)));
+    putValue(out, int32_t(reservedRoomOf(slot)));
+    putValue(out, int16_t(arrivalDayOf(slot)));
+    putValue(out, uint8_t(nightsOf(slot)));
+    putValue(out, hotel->reservationStore.status[slot]);
+    putValue(out, discountOf(slot) / 100.0);
+    putValue(out, uint8_t(nameLength));
+    out.append(guestName.data(), nameLength);
+}
+
+/**
+ * Frames a payload (length + checksum) and appends it to a buffer
+ * @param out Buffer receiving the record
+ * @param payload Record payload
+ */
+void appendRecord(string& out, const string& payload)
+{
+    putValue(out, uint32_t(payload.size()));
+    putValue(out, checksum(payload.data(), payload.size()));
+    out += payload;
+}
+
+/**
+ * Queues a record for the journal, syncing once a group is full and
+ * taking a snapshot every SNAPSHOT_INTERVAL records
+ * @param payload Record payload (starting with journal.nextLsn)
+ */
+void logJournalRecord(const string& payload)
+{
+    appendRecord(hotel->journal.pending, payload);
+    hotel->journal.nextLsn++;
+    hotel->journal.pendingRecords++;
+    hotel->journal.sinceSnapshot++;
+    
+    if (hotel->journal.pendingRecords >= JOURNAL_GROUP_COMMIT) {
+        flushJournal();
+    }
+    if (hotel->journal.sinceSnapshot >= SNAPSHOT_INTERVAL) {
+        writeSnapshot();
+    }
+}
+
+/**
+ * Writes all pending records and forces them to disk (group commit)
+ */
+void syncJournal()
+{
+    unique_lock<shared_mutex> lock(hotel->reservationLock);
+    flushJournal();
+}
+
+/**
+ * Body of syncJournal for callers that already hold reservationLock
+ */
+void flushJournal()
+{
+    if (hotel->journal.fd == -1 || hotel->journal.pending.empty()) {
+        return;
+    }
+    
+    if (!writeAll(hotel->journal.fd, hotel->journal.pending.data(), hotel->journal.pending.size()) ||
+        fsync(hotel->journal.fd) != 0) {
+        cerr << "Error: journal write failed, stopping to avoid losing bookings\n";
+        exit(1);
+    }
+    hotel->journal.pending.clear();
+    hotel->journal.pendingRecords = 0;
+}
+
+/**
+ * Saves the hotel to a new binary snapshot and empties the journal
+ * Only active reservations are written, packed into consecutive slots.
+ * The snapshot is written to a temporary file and renamed into place,
+ * so a crash leaves either the old or the new snapshot. Journal records
+ * that survive a crash before the truncation are skipped by their LSN.
+ * The caller holds reservationLock exclusively.
+ * @return False on I/O error (the journal is kept)
+ */
+bool writeSnapshot()
+{
+    flushJournal();
+    
+    // Gather the active reservations' columns
+    const ReservationStore& store = hotel->reservationStore;
+    vector<int> slots;
+    for (int r = 0; r < reservationSlotCount(); r++) {
+        if (isActiveReservation(r)) {
+            slots.push_back(r);
+        }
+    }
+    size_t count = slots.size();
+    vector<uint8_t> status(count), nights(count);
+    vector<int32_t> roomIndex(count), reservationId(count);
+    vector<int16_t> arrivalDay(count);
+    vector<uint8_t> discountPercent(count);
+    vector<uint32_t> guestIndex(count), guestLength;
+    vector<uint32_t> savedName(store.guestNames.text.size(), UINT32_MAX); // Handle -> index in the file
+    string guestHeap;
+    for (size_t k = 0; k < count; k++) {
+        int r = slots[k];
+        status[k] = store.status[r];
+        roomIndex[k] = store.roomIndex[r];
+        arrivalDay[k] = store.arrivalDay[r];
+        nights[k] = store.nights[r];
+        reservationId[k] = store.reservationId[r];
+        discountPercent[k] = store.discountPercent[r];
+        
+        // Each distinct name is written once, numbered in order of first use
+        uint32_t handle = store.guestHandle[r];
+        if (savedName[handle] == UINT32_MAX) {
+            string_view name = guestNameOf(r);
+            savedName[handle] = static_cast<uint32_t>(guestLength.size());
+            guestLength.push_back(static_cast<uint32_t>(name.size()));
+            guestHeap.append(name.data(), name.size());
+        }
+        guestIndex[k] = savedName[handle];
+    }
+    
+    // Rebuild the calendar from the saved reservations: a booking that
+    // has taken its nights but is not committed yet is not in this
+    // snapshot, so its nights must not be either
+    int wordsPerDay = hotel->calendar.wordsPerDay;
+    vector<uint64_t> freeBits(hotel->calendar.freeBits.size());
+    for (int d = 0; d < CALENDAR_DAYS; d++) {
+        for (int w = 0; w < wordsPerDay; w++) {
+            for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+                freeBits[size_t(d) * wordsPerDay + w] |= hotel->calendar.typeMask[t][w];
+            }
+        }
+    }
+    for (size_t k = 0; k < count; k++) {
+        uint64_t bit = uint64_t(1) << (roomIndex[k] % 64);
+        for (int d = arrivalDay[k]; d < arrivalDay[k] + nights[k]; d++) {
+            freeBits[size_t(d) * wordsPerDay + roomIndex[k] / 64] &= ~bit;
+        }
+    }
+    
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.lastLsn = hotel->journal.nextLsn - 1;
+    header.totalRooms = hotel->totalRooms;
+    header.roomTypeCount = ROOM_TYPE_COUNT;
+    header.calendarDays = CALENDAR_DAYS;
+    header.wordsPerDay = hotel->calendar.wordsPerDay;
+    header.reservationCount = count;
+    header.guestNameCount = guestLength.size();
+    header.guestHeapSize = guestHeap.size();
+    
+    string image(sizeof(SnapshotHeader), '\0');
+    appendSection(image, header, SNAP_ROOM_TYPE, hotel->roomStore.type.data(), hotel->totalRooms * sizeof(uint8_t));
+    appendSection(image, header, SNAP_ROOM_PRICE, hotel->roomStore.basePriceCents.data(), hotel->totalRooms * sizeof(int32_t));
+    appendSection(image, header, SNAP_CALENDAR, freeBits.data(), freeBits.size() * sizeof(uint64_t));
+    appendSection(image, header, SNAP_RES_STATUS, status.data(), count * sizeof(uint8_t));
+    appendSection(image, header, SNAP_RES_ROOM, roomIndex.data(), count * sizeof(int32_t));
+    appendSection(image, header, SNAP_RES_ARRIVAL, arrivalDay.data(), count * sizeof(int16_t));
+    appendSection(image, header, SNAP_RES_NIGHTS, nights.data(), count * sizeof(uint8_t));
+    appendSection(image, header, SNAP_RES_ID, reservationId.data(), count * sizeof(int32_t));
+    appendSection(image, header, SNAP_RES_DISCOUNT, discountPercent.data(), count * sizeof(uint8_t));
+    appendSection(image, header, SNAP_RES_GUEST, guestIndex.data(), count * sizeof(uint32_t));
+    appendSection(image, header, SNAP_GUEST_LENGTH, guestLength.data(), guestLength.size() * sizeof(uint32_t));
+    appendSection(image, header, SNAP_GUEST_HEAP, guestHeap.data(), guestHeap.size());
+    header.fileSize = image.size();
+    header.headerChecksum = checksum(reinterpret_cast<const char*>(&header),
+                                     offsetof(SnapshotHeader, headerChecksum));
+    memcpy(&image[0], &header, sizeof(header));
+    
+    string path = hotel->journal.directory + "/hotel.snapshot";
+    string tempPath = path + ".tmp";
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd != -1 && writeAll(fd, image.data(), image.size()) && fsync(fd) == 0;
+    if (fd != -1) close(fd);
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        cerr << "Warning: snapshot failed, keeping the journal\n";
+        return false;
+    }
+    
+    // Records up to lastLsn now live in the snapshot
+    if (ftruncate(hotel->journal.fd, 0) != 0) {
+        cerr << "Warning: could not truncate journal after snapshot\n";
+    }
+    hotel->journal.sinceSnapshot = 0;
+    return true;
+}
+
+/**
+ * Appends one snapshot section, padded to an 8-byte boundary
+ * @param image Snapshot being built
+ * @param header Receives the section's offset
+ * @param section SnapshotSection index
+ * @param data Section contents
+ * @param size Section size in bytes
+ */
+void appendSection(string& image, SnapshotHeader& header, int section,
+                   const void* data, size_t size)
+{
+    header.sectionOffset[section] = image.size();
+    image.append(static_cast<const char*>(data), size);
+    image.append((8 - image.size() % 8) % 8, '\0');
+}
+
+/**
+ * Loads a binary snapshot by mapping it and copying each section into
+ * its column. The name index is built on first use, not here.
+ * Only the header is checksummed, so every reservation is checked the
+ * way journal replay checks a booking, and the calendar is rebuilt from
+ * the reservations and must match the saved one.
+ * @param path Snapshot file
+ * @param lastLsn Receives the last journal LSN the snapshot includes
+ * @return False if the file is missing, truncated, of another version
+ *         or holds reservations that cannot exist
+ */
+bool loadSnapshot(const string& path, uint64_t& lastLsn)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t fileSize = info.st_size;
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const char* base = static_cast<const char*>(mapping);
+    
+    // Validate the header before trusting any offset in it
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    size_t count = header.reservationCount;
+    bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SNAPSHOT_VERSION &&
+                 header.headerSize == sizeof(SnapshotHeader) &&
+                 header.headerChecksum == checksum(reinterpret_cast<const char*>(&header),
+                                                   offsetof(SnapshotHeader, headerChecksum)) &&
+                 header.fileSize == fileSize &&
+                 header.calendarDays == CALENDAR_DAYS &&
+                 header.totalRooms > 0 &&
+                 header.roomTypeCount > 0 && header.roomTypeCount <= ROOM_TYPE_COUNT &&
+                 header.wordsPerDay == (header.totalRooms + 63) / 64;
+    size_t sectionSize[SNAPSHOT_SECTIONS] = {
+        header.totalRooms * sizeof(uint8_t), header.totalRooms * sizeof(int32_t),
+        size_t(CALENDAR_DAYS) * header.wordsPerDay * sizeof(uint64_t),
+        count * sizeof(uint8_t), count * sizeof(int32_t), count * sizeof(int16_t),
+        count * sizeof(uint8_t), count * sizeof(int32_t), count * sizeof(uint8_t),
+        count * sizeof(uint32_t), header.guestNameCount * sizeof(uint32_t), header.guestHeapSize
+    };
+    for (int k = 0; valid && k < SNAPSHOT_SECTIONS; k++) {
+        valid = header.sectionOffset[k] % 8 == 0 &&
+                header.sectionOffset[k] <= fileSize &&
+                sectionSize[k] <= fileSize - header.sectionOffset[k];
+    }
+    if (!valid) {
+        munmap(mapping, fileSize);
+        return false;
+    }
+    
+    // Copies one section into a column
+    auto load = [&](auto& column, int section) {
+        using T = typename remove_reference<decltype(column)>::type::value_type;
+        const T* first = reinterpret_cast<const T*>(base + header.sectionOffset[section]);
+        column.assign(first, first + sectionSize[section] / sizeof(T));
+    };
+    
+    // Rooms are numbered by type, so the type column gives the layout
+    const uint8_t* roomType = reinterpret_cast<const uint8_t*>(base + header.sectionOffset[SNAP_ROOM_TYPE]);
+    int roomCounts[ROOM_TYPE_COUNT] = {0};
+    int32_t noPrices[ROOM_TYPE_COUNT] = {0};
+    for (int i = 0; valid && i < header.totalRooms; i++) {
+        valid = roomType[i] < header.roomTypeCount && (i == 0 || roomType[i] >= roomType[i-1]);
+        if (valid) roomCounts[roomType[i]]++;
+    }
+    if (!valid) {
+        munmap(mapping, fileSize);
+        return false;
+    }
+    setupRooms(roomCounts, noPrices);
+    load(hotel->roomStore.basePriceCents, SNAP_ROOM_PRICE);
+    for (int32_t priceCents : hotel->roomStore.basePriceCents) {
+        valid = valid && priceCents >= 0 && priceCents <= MAX_BASE_PRICE_CENTS;
+    }
+    
+    ReservationStore& store = hotel->reservationStore;
+    load(store.status, SNAP_RES_STATUS);
+    load(store.roomIndex, SNAP_RES_ROOM);
+    load(store.arrivalDay, SNAP_RES_ARRIVAL);
+    load(store.nights, SNAP_RES_NIGHTS);
+    load(store.reservationId, SNAP_RES_ID);
+    load(store.discountPercent, SNAP_RES_DISCOUNT);
+    load(store.guestHandle, SNAP_RES_GUEST);
+    
+    // Take each reservation's nights in the empty calendar setupRooms
+    // made; a stay outside the calendar or on a taken night is corrupt
+    for (size_t r = 0; valid && r < count; r++) {
+        int roomIndex = store.roomIndex[r];
+        valid = (store.status[r] & RES_ACTIVE) != 0 && store.reservationId[r] > 0 &&
+                store.discountPercent[r] <= 100 &&
+                roomIndex >= 0 && roomIndex < hotel->totalRooms &&
+                isValidStay(store.arrivalDay[r], store.nights[r]) &&
+                isRoomFreeFor(roomIndex, store.arrivalDay[r], store.nights[r]);
+        if (valid) {
+            setRoomNights(roomIndex, store.arrivalDay[r], store.nights[r], false);
+        }
+    }
+    valid = valid && memcmp(hotel->calendar.freeBits.data(), base + header.sectionOffset[SNAP_CALENDAR],
+                            sectionSize[SNAP_CALENDAR]) == 0;
+    
+    // Intern the distinct names in file order, so name k gets handle k
+    const uint32_t* guestLength = reinterpret_cast<const uint32_t*>(base + header.sectionOffset[SNAP_GUEST_LENGTH]);
+    const char* guestText = base + header.sectionOffset[SNAP_GUEST_HEAP];
+    uint64_t heapUsed = 0;
+    for (uint64_t k = 0; valid && k < header.guestNameCount; k++) {
+        valid = guestLength[k] <= header.guestHeapSize - heapUsed &&
+                internGuestName(string_view(guestText + heapUsed, guestLength[k])) == k;
+        heapUsed += guestLength[k];
+    }
+    munmap(mapping, fileSize);
+    
+    // Each name was interned once; count its reservations instead
+    GuestNamePool& pool = store.guestNames;
+    fill(pool.references.begin(), pool.references.end(), 0);
+    for (size_t r = 0; valid && r < count; r++) {
+        valid = store.guestHandle[r] < header.guestNameCount;
+        if (valid) pool.references[store.guestHandle[r]]++;
+    }
+    if (!valid) {
+        return false;
+    }
+    
+    // Rebuild the ID lookup; defer the name index until it is queried
+    hotel->reservationIndex.reserve(count);
+    for (size_t r = 0; r < count; r++) {
+        hotel->reservationIndex[store.reservationId[r]] = static_cast<int>(r);
+    }
+    if (hotel->reservationIndex.size() != count) {
+        return false; // Two reservations with one ID
+    }
+    hotel->nameIndex.built = false;
+    rebuildTotals();
+    hotel->nameIndex.slotTrigrams.resize(count);
+    
+    lastLsn = header.lastLsn;
+    return true;
+}
+
+/**
+ * Flushes outstanding records and closes the journal
+ */
+void closeJournal()
+{
+    if (hotel->journal.fd == -1) {
+        return;
+    }
+    syncJournal();
+    close(hotel->journal.fd);
+    hotel->journal.fd = -1;
+}
+
+/**
+ * Reads a whole file into memory
+ * @param path File to read
+ * @param data Receives the contents
+ * @return False if the file does not exist or cannot be read
+ */
+bool readWholeFile(const string& path, string& data)
+{
+    ifstream in(path, ios::binary);
+    if (!in) {
+        return false;
+    }
+    ostringstream contents;
+    contents << in.rdbuf();
+    data = contents.str();
+    return true;
+}
+
+/**
+ * Writes a buffer completely, retrying short writes
+ * @param fd File descriptor
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return False on error
+ */
+bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+/**
+ * FNV-1a checksum used to detect torn or corrupt records
+ * @param data Bytes to hash
+ * @param size Number of bytes
+ * @return 32-bit checksum
+ */
+uint32_t checksum(const char* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ uint8_t(data[i])) * 16777619u;
+    }
+    return hash;
+}
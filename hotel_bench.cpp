@@ -0,0 +1,221 @@
+// Microbenchmarks for the reservation hot paths of hotel.cpp
+// Build: g++ -std=c++17 -O2 -pthread hotel_bench.cpp -o hotel_bench
+// Usage: hotel_bench [--sizes 40,300,10000,1000000] [--occupancy 0,50,90,100]
+//                    [--min-time SECONDS] [--seed N] > results.json
+//
+// Every benchmark runs against a hotel of each size filled to each
+// occupancy, and the results are written as JSON, one record per
+// (benchmark, size, occupancy), so that runs can be compared between
+// releases.
+#define main hotelMain
+#include "hotel.cpp"
+#undef main
+
+//  1. Constants and global variables
+const int BENCH_STAY_NIGHTS = 7;   // Occupied stays and queries cover days 0-6
+const int BENCH_INPUTS = 4096;     // Pre-drawn arguments per benchmark
+const int BENCH_GUEST_NAMES = 10000; // Distinct guest names in a filled hotel
+
+// One measurement
+struct BenchResult
+{
+    string name;        // Function under test
+    int rooms;          // Hotel size
+    int occupancy;      // Percent of rooms booked for days 0-6
+    long iterations;    // Calls timed
+    double nsPerOp;     // Mean time per call
+};
+
+double minTime = 0.2;   // Seconds each benchmark runs at least
+uint64_t benchSink = 0; // Consumes results so calls are not optimized away
+
+// 2. Function declarations
+void fillHotel(int rooms, int occupancy);
+template <typename Call>
+BenchResult measure(const string& name, int rooms, int occupancy, Call call);
+vector<int> parseList(const string& text);
+void writeJson(ostream& out, const vector<BenchResult>& results, unsigned int seed);
+
+// 3. Main function
+int main(int argc, char* argv[])
+{
+    vector<int> sizes = {40, 300, 10000, 1000000};
+    vector<int> occupancies = {0, 50, 90, 100};
+    unsigned int seed = 1;
+
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            sizes = parseList(argv[++i]);
+        } else if (arg == "--occupancy" && i + 1 < argc) {
+            occupancies = parseList(argv[++i]);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minTime = atof(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+        } else {
+            cerr << "Usage: " << argv[0] << " [--sizes N,...] [--occupancy PERCENT,...]"
+                 << " [--min-time SECONDS] [--seed N]\n";
+            return 1;
+        }
+    }
+    promptOut = &nullStream; // isRoomAvailable reports refusals here
+
+    vector<BenchResult> results;
+    for (int rooms : sizes) {
+        for (int occupancy : occupancies) {
+            seedRandom(seed);
+            fillHotel(rooms, occupancy);
+            cerr << "Benchmarking " << rooms << " rooms at " << occupancy << "% occupancy\n";
+
+            // Arguments are drawn up front so the timed loops only call
+            vector<int> roomNumbers(BENCH_INPUTS), nights(BENCH_INPUTS), ids(BENCH_INPUTS);
+            vector<int> arrivals(BENCH_INPUTS);
+            vector<string> names(BENCH_INPUTS);
+            for (int k = 0; k < BENCH_INPUTS; k++) {
+                roomNumbers[k] = 1 + randomBelow(rooms);
+                nights[k] = 1 + randomBelow(BENCH_STAY_NIGHTS);
+                arrivals[k] = randomBelow(CALENDAR_DAYS - BENCH_STAY_NIGHTS);
+                names[k] = "guest " + to_string(randomBelow(BENCH_GUEST_NAMES)) + "/";
+                ids[k] = randomBelow(2) == 0 || hotel->reservationIndex.empty()
+                         ? 10000 + randomBelow(90000) // Mostly misses
+                         : reservationIdOf(randomBelow(reservationSlotCount()));
+            }
+            ostringstream listing;
+            ofstream devNull("/dev/null", ios::binary);
+
+            results.push_back(measure("calculateFinalPrice", rooms, occupancy, [&](long k) {
+                benchSink += calculateFinalPrice(roomNumbers[k % BENCH_INPUTS], arrivals[k % BENCH_INPUTS],
+                                                 nights[k % BENCH_INPUTS], 10, k % 2 == 0);
+            }));
+            results.push_back(measure("quoteDiscount", rooms, occupancy, [&](long k) {
+                benchSink += quoteDiscount(k % ROOM_TYPE_COUNT, arrivals[k % BENCH_INPUTS], nights[k % BENCH_INPUTS]);
+            }));
+            results.push_back(measure("totalRevenue", rooms, occupancy, [&](long) {
+                int reservations = 0;
+                benchSink += totalRevenue(reservations) + reservations;
+            }));
+            results.push_back(measure("isRoomAvailable", rooms, occupancy, [&](long k) {
+                int room = roomNumbers[k % BENCH_INPUTS];
+                benchSink += isRoomAvailable(room, roomTypeOf(room - 1), 0, nights[k % BENCH_INPUTS]);
+            }));
+            results.push_back(measure("findReservationById", rooms, occupancy, [&](long k) {
+                benchSink += findReservationById(ids[k % BENCH_INPUTS]) + 1;
+            }));
+            results.push_back(measure("findReservationsByName", rooms, occupancy, [&](long k) {
+                benchSink += findReservationsByName(names[k % BENCH_INPUTS]).size();
+            }));
+            results.push_back(measure("assignRandomRoom", rooms, occupancy, [&](long k) {
+                benchSink += assignRandomRoom(k % ROOM_TYPE_COUNT, 0, nights[k % BENCH_INPUTS]) + 1;
+            }));
+            results.push_back(measure("findRoomBlock", rooms, occupancy, [&](long k) {
+                benchSink += findRoomBlock(k % ROOM_TYPE_COUNT, 10, 0, nights[k % BENCH_INPUTS]) + 1;
+            }));
+            results.push_back(measure("displayAvailableRooms", rooms, occupancy, [&](long k) {
+                listing.str("");
+                displayAvailableRooms(listing, 0, nights[k % BENCH_INPUTS]);
+                benchSink += listing.tellp();
+            }));
+            results.push_back(measure("exportCsv", rooms, occupancy, [&](long) {
+                int listed = 0;
+                benchSink += writeReservationReport(devNull, ReportQuery(), REPORT_CSV, listed);
+            }));
+        }
+    }
+
+    writeJson(cout, results, seed);
+    return benchSink == 42 ? 1 : 0; // Never true in practice; keeps benchSink live
+}
+
+// ====================== Below are FUNCTION DEFINITIONS ======================
+
+/**
+ * Builds a fresh hotel and books a share of its rooms for days 0-6
+ * @param rooms Hotel size (split by room type share)
+ * @param occupancy Percent of rooms to book (0-100)
+ */
+void fillHotel(int rooms, int occupancy)
+{
+    int roomCounts[ROOM_TYPE_COUNT];
+    int32_t priceCents[ROOM_TYPE_COUNT];
+    splitRooms(rooms, roomCounts);
+    for (int t = 0; t < ROOM_TYPE_COUNT; t++) {
+        priceCents[t] = ROOM_TYPES[t].minPriceEur * 100;
+    }
+    setupRooms(roomCounts, priceCents);
+    for (int i = 0; i < rooms; i++) {
+        if (randomBelow(100) < occupancy) {
+            commitReservation(i + 1, generateReservationId(),
+                              "Guest " + to_string(randomBelow(BENCH_GUEST_NAMES)) + "/",
+                              0, BENCH_STAY_NIGHTS, quoteDiscount(roomTypeOf(i), 0, BENCH_STAY_NIGHTS), false);
+        }
+    }
+    buildNameIndex();
+}
+
+/**
+ * Times a call repeatedly, doubling the batch until minTime is reached
+ * @param name Benchmark name
+ * @param rooms Hotel size
+ * @param occupancy Percent of rooms booked
+ * @param call Callable taking the iteration number
+ * @return Mean time per call over the last batch
+ */
+template <typename Call>
+BenchResult measure(const string& name, int rooms, int occupancy, Call call)
+{
+    call(0); // Warm up caches and lazy state
+
+    long iterations = 1;
+    double seconds = 0.0;
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        for (long k = 0; k < iterations; k++) {
+            call(k);
+        }
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds >= minTime || iterations >= (1L << 40)) {
+            break;
+        }
+        iterations *= 2;
+    }
+    return {name, rooms, occupancy, iterations, seconds * 1e9 / iterations};
+}
+
+/**
+ * Parses a comma-separated list of integers
+ * @param text List such as "40,300,10000"
+ * @return Values in order
+ */
+vector<int> parseList(const string& text)
+{
+    vector<int> values;
+    istringstream items(text);
+    string item;
+    while (getline(items, item, ',')) {
+        values.push_back(atoi(item.c_str()));
+    }
+    return values;
+}
+
+/**
+ * Writes all results as one JSON document
+ * @param out Destination stream
+ * @param results Measurements
+ * @param seed Seed used to fill the hotels
+ */
+void writeJson(ostream& out, const vector<BenchResult>& results, unsigned int seed)
+{
+    out << "{\n  \"suite\": \"hotel_bench\",\n  \"seed\": " << seed
+        << ",\n  \"min_time_s\": " << minTime << ",\n  \"results\": [\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const BenchResult& result = results[k];
+        out << "    {\"name\": \"" << result.name << "\", \"rooms\": " << result.rooms
+            << ", \"occupancy\": " << result.occupancy << ", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << fixed << setprecision(2) << result.nsPerOp << "}"
+            << (k + 1 < results.size() ? "," : "") << "\n";
+        out.unsetf(ios::floatfield);
+    }
+    out << "  ]\n}\n";
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Batch-mode regression test for hotel.cpp
+# Usage: tests/regression.sh        (after every build; exit status 1 on a difference)
+#        UPDATE=1 tests/regression.sh  (rewrite the .expected files after an intended change)
+#
+# Builds hotel.cpp, then runs session.batch and recovery.batch with
+# --seed 1 on one fresh data directory, so the second run starts from
+# the first run's snapshot and journal. The output of each run must
+# match its .expected file. Latency buckets and sums depend on the
+# machine, so `stats` output is compared by its counts only.
+set -e
+cd "$(dirname "$0")"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+${CXX:-g++} -std=c++17 -O2 -pthread ../hotel.cpp -o "$work/hotel"
+mkdir "$work/data"
+
+status=0
+for run in session recovery; do
+    "$work/hotel" --batch "$run.batch" --seed 1 --data-dir "$work/data" > "$work/$run.raw"
+    grep -v -e '_bucket{.*le="[0-9]' -e '_sum{' "$work/$run.raw" > "$work/$run.out"
+    if [ "${UPDATE:-0}" = 1 ]; then
+        cp "$work/$run.out" "$run.expected"
+    elif ! diff -u "$run.expected" "$work/$run.out"; then
+        echo "FAILED: $run.batch"
+        status=1
+    fi
+done
+[ $status = 0 ] && echo "Batch regression passed"
+exit $status